@@ -18,6 +18,7 @@
 #include <apt-pkg/acquire-worker.h>
 #include <apt-pkg/acquire.h>
 #include <apt-pkg/aptconfiguration.h>
+#include <apt-pkg/clean.h>
 #include <apt-pkg/configuration.h>
 #include <apt-pkg/error.h>
 #include <apt-pkg/fileutl.h>
@@ -39,7 +40,10 @@
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
+#include <functional>
 #include <iostream>
+#include <locale>
+#include <map>
 #include <memory>
 #include <numeric>
 #include <random>
@@ -122,6 +126,156 @@ static std::string GetDiffIndexURI(IndexTarget const &Target) /*{{{*/
   return Target.URI + ".diff/Index";
 }
 /*}}}*/
+// CompressionRates - pick the compression type done first		/*{{{*/
+/* With Acquire::CompressionTypes::Adaptive the compression types of an
+   index are tried in the order in which downloading and decompressing them
+   is expected to be done first instead of the configured order: A xz file
+   is smallest, but on a fast link the bigger gz or uncompressed file is
+   there before the xz file is decompressed.
+
+   For this the rate with which index files are downloaded from a site
+   and the rate with which each compression type is decompressed (counted
+   in compressed bytes per second) are measured and kept in
+   Dir::State::compression_rates between runs. Until a type was seen once,
+   a rough guess is used for it; without a measured rate for the site the
+   configured order is kept. */
+class APT_HIDDEN CompressionRates
+{
+  // rates in bytes per second
+  std::map<std::string, double> Sites;
+  std::map<std::string, double> Types;
+  bool Loaded = false;
+  bool Changed = false;
+
+  void Load()
+  {
+    if (Loaded)
+      return;
+    Loaded = true;
+    std::string const File = _config->FindFile("Dir::State::compression_rates");
+    if (RealFileExists(File) == false)
+      return;
+    FileFd Fd(File, FileFd::ReadOnly);
+    pkgTagFile Tags(&Fd);
+    pkgTagSection Section;
+    while (Tags.Step(Section))
+    {
+      double const Rate = Section.FindULL("Rate");
+      if (Rate <= 0)
+        continue;
+      if (Section.Exists("Site"))
+        Sites[Section.FindS("Site")] = Rate;
+      else if (Section.Exists("Compression-Type"))
+        Types[Section.FindS("Compression-Type")] = Rate;
+    }
+  }
+  static void Measured(double &Rate, double const Sample)
+  {
+    // let the past count, but adapt quickly if the situation changed
+    Rate = (Rate <= 0) ? Sample : (Rate * 3 + Sample) / 4;
+  }
+  double TypeRate(std::string const &Type)
+  {
+    auto const Known = Types.find(Type);
+    if (Known != Types.end())
+      return Known->second;
+    // rough guesses for one core in compressed MB/s
+    static std::map<std::string, double> const Guesses = {
+       {"uncompressed", 500}, {"lz4", 500}, {"zst", 200}, {"gz", 60}, {"xz", 12}, {"lzma", 12}, {"bz2", 8}};
+    auto const Guess = Guesses.find(Type);
+    return (Guess == Guesses.end()) ? 0 : Guess->second * 1000 * 1000;
+  }
+
+  public:
+  static bool Enabled()
+  {
+    return _config->FindB("Acquire::CompressionTypes::Adaptive", false);
+  }
+  void Downloaded(std::string const &URI, unsigned long long const Size, double const Seconds)
+  {
+    // small files measure the latency more than the bandwidth
+    if (Size < 64 * 1024 || Seconds <= 0)
+      return;
+    Load();
+    Measured(Sites[::URI::SiteOnly(URI)], Size / Seconds);
+    Changed = true;
+  }
+  void Decompressed(std::string const &Type, unsigned long long const Size, double const Seconds)
+  {
+    if (Size < 64 * 1024 || Seconds <= 0)
+      return;
+    Load();
+    Measured(Types[Type], Size / Seconds);
+    Changed = true;
+  }
+  /** \brief sort the types by the expected time to download and decompress them */
+  void Sort(std::string const &URI, std::vector<std::string> &Order, std::function<unsigned long long(std::string const &)> const &Size)
+  {
+    if (Order.size() < 2)
+      return;
+    Load();
+    auto const Site = Sites.find(::URI::SiteOnly(URI));
+    if (Site == Sites.end())
+      return;
+    std::map<std::string, double> Expected;
+    for (auto const &Type : Order)
+    {
+      double const Rate = TypeRate(Type);
+      unsigned long long const Bytes = Size(Type);
+      if (Rate <= 0 || Bytes == 0)
+        return;
+      Expected[Type] = Bytes / Site->second + Bytes / Rate;
+    }
+    std::stable_sort(Order.begin(), Order.end(), [&](std::string const &A, std::string const &B)
+                     { return Expected[A] < Expected[B]; });
+    if (_config->FindB("Debug::Acquire::CompressionTypes", false))
+    {
+      std::clog << "Compression types for " << URI << ":";
+      for (auto const &Type : Order)
+        std::clog << ' ' << Type << " (" << Expected[Type] << "s)";
+      std::clog << std::endl;
+    }
+  }
+  void Save()
+  {
+    if (Changed == false)
+      return;
+    Changed = false;
+    // not being able to remember the rates is no reason to fail
+    _error->PushToStack();
+    {
+      std::ostringstream Out;
+      Out.imbue(std::locale::classic());
+      for (auto const &Site : Sites)
+        Out << "Site: " << Site.first << "\nRate: " << static_cast<unsigned long long>(Site.second) << "\n\n";
+      for (auto const &Type : Types)
+        Out << "Compression-Type: " << Type.first << "\nRate: " << static_cast<unsigned long long>(Type.second) << "\n\n";
+      std::string const Content = Out.str();
+      FileFd Fd(_config->FindFile("Dir::State::compression_rates"), FileFd::WriteAtomic, 0644);
+      if (Fd.Write(Content.c_str(), Content.length()) == false)
+        Fd.OpFail();
+      Fd.Close();
+    }
+    _error->RevertToStack();
+  }
+};
+static CompressionRates &GetCompressionRates()
+{
+  static CompressionRates Rates;
+  return Rates;
+}
+/*}}}*/
+static pkgArchiveHashes *GetArchiveHashes() /*{{{*/
+{
+  static std::unique_ptr<pkgArchiveHashes> Hashes;
+  if (_config->FindB("APT::Remember-Archive-Hashes", true) == false)
+    return nullptr;
+  std::string const Dir = _config->FindDir("Dir::Cache::Archives");
+  if (Hashes == nullptr || Hashes->Directory() != Dir)
+    Hashes.reset(new pkgArchiveHashes(Dir));
+  return Hashes.get();
+}
+/*}}}*/
 
 static void ReportMirrorFailureToCentral(pkgAcquire::Item const &I, std::string const &FailCode, std::string const &Details) /*{{{*/
 {
@@ -319,6 +473,7 @@ class pkgAcquire::Item::Private /*{{{*/
   std::vector<std::string> PastRedirections;
   std::unordered_map<std::string, std::string> CustomFields;
   time_point FetchAfter = {};
+  time_point Started = {};
 
   Private()
   {
@@ -1055,6 +1210,7 @@ void pkgAcquire::Item::Start(string const & /*Message*/, unsigned long long cons
   ErrorText.clear();
   if (FileSize == 0 && Complete == false)
     FileSize = Size;
+  d->Started = clock::now();
 }
 /*}}}*/
 // Acquire::Item::VerifyDone - check if Item was downloaded OK		/*{{{*/
@@ -1178,6 +1334,10 @@ pkgAcquire::time_point pkgAcquire::Item::FetchAfter()
 {
   return d->FetchAfter;
 }
+pkgAcquire::time_point pkgAcquire::Item::Started() const
+{
+  return d->Started;
+}
 /*}}}*/
 bool pkgAcquire::Item::IsRedirectionLoop(std::string const &NewURI) /*{{{*/
 {
@@ -1377,6 +1537,9 @@ void pkgAcqMetaBase::CommitTransaction()
     (*I)->TransactionState(TransactionCommit);
   }
   Transaction.clear();
+
+  if (CompressionRates::Enabled())
+    GetCompressionRates().Save();
 }
 /*}}}*/
 // AcqMetaBase::TransactionStageCopy - Stage a file for copying		/*{{{*/
@@ -1739,6 +1902,11 @@ void pkgAcqMetaClearSig::QueueIndexes(bool const verify) /*{{{*/
 	    std::string const MetaKey = Target.MetaKey + "." + t;
 	    return TransactionManager->MetaIndexParser->Exists(MetaKey) == false; }),
                   types.end());
+      if (CompressionRates::Enabled())
+        GetCompressionRates().Sort(Target.URI, types, [&](std::string const &t)
+                                   {
+                                     auto const hashes = TransactionManager->MetaIndexParser->Lookup(t == "uncompressed" ? Target.MetaKey : Target.MetaKey + "." + t);
+                                     return hashes == nullptr ? 0 : hashes->Hashes.FileSize(); });
       if (types.empty() == false)
       {
         std::ostringstream os;
@@ -3318,6 +3486,27 @@ void pkgAcqIndex::Done(string const &Message,
 {
   Item::Done(Message, Hashes, Cfg);
 
+  if (CompressionRates::Enabled() && Started() != decltype(Started()){})
+  {
+    std::chrono::duration<double> const Took = std::chrono::steady_clock::now() - Started();
+    if (Stage == STAGE_DOWNLOAD)
+    {
+      if (StringToBool(LookupTag(Message, "IMS-Hit"), false) == false)
+        GetCompressionRates().Downloaded(Target.URI, Hashes.FileSize(), Took.count());
+    }
+    else if (APT::String::Startswith(Desc.URI, "store:"))
+    {
+      std::string const Input = DeQuoteString(Desc.URI.substr(strlen("store:")));
+      std::string Type = flExtension(flNotDir(Input));
+      auto const Types = APT::Configuration::getCompressionTypes();
+      if (std::find(Types.begin(), Types.end(), Type) == Types.end())
+        Type = "uncompressed";
+      struct stat Buf;
+      if (stat(Input.c_str(), &Buf) == 0)
+        GetCompressionRates().Decompressed(Type, Buf.st_size, Took.count());
+    }
+  }
+
   switch (Stage)
   {
   case STAGE_DOWNLOAD:
@@ -3563,8 +3752,21 @@ pkgAcqArchive::pkgAcqArchive(pkgAcquire *const Owner, pkgSourceList *const Sourc
   auto FinalFile = _config->FindDir("Dir::Cache::Archives") + flNotDir(StoreFilename);
   if (stat(FinalFile.c_str(), &Buf) == 0)
   {
-    // Make sure the size matches
-    if ((unsigned long long)Buf.st_size == Version->Size)
+    // Make sure the size matches – and the hashes if we verified the file before
+    bool Mismatch = false;
+    auto const ArchiveHashes = GetArchiveHashes();
+    if (ArchiveHashes != nullptr)
+    {
+      for (auto const &Known : ArchiveHashes->Find(FinalFile, Buf))
+      {
+        auto const Expected = ExpectedHashes.find(Known.HashType());
+        if (Expected != nullptr && *Expected != Known)
+          Mismatch = true;
+      }
+    }
+    if (Mismatch)
+      ArchiveHashes->Forget(FinalFile);
+    else if ((unsigned long long)Buf.st_size == Version->Size)
     {
       Complete = true;
       Local = true;
@@ -3573,8 +3775,8 @@ pkgAcqArchive::pkgAcqArchive(pkgAcquire *const Owner, pkgSourceList *const Sourc
       return;
     }
 
-    /* Hmm, we have a file and its size does not match, this shouldn't
-   happen.. */
+    /* Hmm, we have a file and its size or hashes do not match, this
+       shouldn't happen.. */
     RemoveFile("pkgAcqArchive::QueueNext", FinalFile);
   }
 
@@ -3633,6 +3835,9 @@ void pkgAcqArchive::Done(string const &Message, HashStringList const &Hashes,
   Rename(DestFile, FinalFile);
   StoreFilename = DestFile = FinalFile;
   Complete = true;
+  // next time we can compare more than the size without reading it again
+  if (auto const ArchiveHashes = GetArchiveHashes())
+    ArchiveHashes->Add(FinalFile, Hashes);
 }
 /*}}}*/
 // AcqArchive::Failed - Failure handler					/*{{{*/
@@ -302,6 +302,8 @@ class APT_PUBLIC pkgAcquire::Item : public WeakPointable /*{{{*/
   /** \brief internal clock definitions to avoid typing all that all over the place */
   void APT_HIDDEN FetchAfter(time_point FetchAfter);
   time_point APT_HIDDEN FetchAfter();
+  /** \brief when the method reported to have started on the current URI */
+  time_point APT_HIDDEN Started() const;
 
   protected:
   /** \brief The acquire object with which this item is associated. */
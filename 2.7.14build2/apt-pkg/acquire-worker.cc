@@ -174,6 +174,7 @@ bool pkgAcquire::Worker::Start()
   RunMessages();
   if (OwnerQ != 0)
     SendConfiguration();
+  Watch();
 
   return true;
 }
@@ -559,6 +560,7 @@ bool pkgAcquire::Worker::RunMessages()
           clog << " -> " << Access << ':' << QuoteString(Msg, "\n") << endl;
         OutQueue += Msg;
         OutReady = true;
+        Watch();
         break;
       }
 
@@ -756,6 +758,7 @@ bool pkgAcquire::Worker::MediaChange(string Message)
       clog << " -> " << Access << ':' << QuoteString(S, "\n") << endl;
     OutQueue += S;
     OutReady = true;
+    Watch();
     return true;
   }
 
@@ -765,6 +768,7 @@ bool pkgAcquire::Worker::MediaChange(string Message)
     clog << " -> " << Access << ':' << QuoteString(S, "\n") << endl;
   OutQueue += S;
   OutReady = true;
+  Watch();
   return true;
 }
 /*}}}*/
@@ -792,6 +796,7 @@ bool pkgAcquire::Worker::SendConfiguration()
     clog << " -> " << Access << ':' << QuoteString(Message.str(), "\n") << endl;
   OutQueue += Message.str();
   OutReady = true;
+  Watch();
 
   return true;
 }
@@ -861,6 +866,7 @@ bool pkgAcquire::Worker::QueueItem(pkgAcquire::Queue::QItem *Item)
     clog << " -> " << Access << ':' << QuoteString(Message, "\n") << endl;
   OutQueue += Message;
   OutReady = true;
+  Watch();
 
   return true;
 }
@@ -901,6 +907,7 @@ bool pkgAcquire::Worker::ReplyAux(pkgAcquire::ItemDesc const &Item)
     clog << " -> " << Access << ':' << QuoteString(Message, "\n") << endl;
   OutQueue += Message;
   OutReady = true;
+  Watch();
 
   return true;
 }
@@ -921,7 +928,10 @@ bool pkgAcquire::Worker::OutFdReady()
 
   OutQueue.erase(0, Res);
   if (OutQueue.empty() == true)
+  {
     OutReady = false;
+    Watch();
+  }
 
   return true;
 }
@@ -948,18 +958,30 @@ bool pkgAcquire::Worker::MethodFailure()
   // do not reap the child here to show meaningful error to the user
   ExecWait(Process, Access.c_str(), false);
   Process = -1;
+  // the descriptors can't be watched anymore once they are closed
+  OutReady = false;
+  InReady = false;
+  Watch();
   close(InFd);
   close(OutFd);
   InFd = -1;
   OutFd = -1;
-  OutReady = false;
-  InReady = false;
   OutQueue = string();
   MessageQueue.erase(MessageQueue.begin(), MessageQueue.end());
 
   return false;
 }
 /*}}}*/
+// Worker::Watch - Tell the owner which descriptors to watch		/*{{{*/
+// ---------------------------------------------------------------------
+/* Workers without a queue are only used to probe the method configuration
+   and talk to the method directly. */
+void pkgAcquire::Worker::Watch()
+{
+  if (OwnerQ != nullptr)
+    OwnerQ->Owner->Watch(this);
+}
+/*}}}*/
 // Worker::Pulse - Called periodically					/*{{{*/
 // ---------------------------------------------------------------------
 /* */
@@ -316,6 +316,8 @@ class APT_PUBLIC pkgAcquire::Worker : public WeakPointable
   APT_HIDDEN void HandleFailure(std::vector<pkgAcquire::Item *> const &ItmOwners,
                                 pkgAcquire::MethodConfig *const Config, pkgAcquireStatus *const Log,
                                 std::string const &Message, bool const errTransient, bool const errAuthErr);
+  /** \brief Tell the owner about changes to #InReady and #OutReady. */
+  APT_HIDDEN void Watch();
 };
 
 /** @} */
@@ -33,6 +33,8 @@
 #include <sstream>
 #include <string>
 #include <tuple>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <cerrno>
@@ -42,7 +44,11 @@
 #include <dirent.h>
 #include <fcntl.h>
 #include <grp.h>
+#include <poll.h>
 #include <pwd.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
 #include <sys/select.h>
 #include <sys/stat.h>
 #include <sys/time.h>
@@ -61,6 +67,246 @@ constexpr struct timeval SteadyDurationToTimeVal(std::chrono::steady_clock::dura
   return timeval{static_cast<time_t>(Time_sec.count()), static_cast<suseconds_t>(Time_usec.count())};
 }
 
+// Acquire::Private - Watch the file descriptors of the workers	/*{{{*/
+// ---------------------------------------------------------------------
+/* Workers register their descriptors while they wait for input or have
+   output pending, so Run() only hears about workers with activity instead
+   of collecting and checking all of them in every cycle. epoll is used if
+   available, poll otherwise. Each registration gets a serial number so that
+   events for a descriptor which was closed (and perhaps reused by another
+   worker) while handling earlier events of the same batch are ignored. */
+class pkgAcquire::Private
+{
+  struct Registration
+  {
+    Worker *Work;
+    uint32_t Serial;
+    size_t Slot;
+  };
+  std::unordered_map<int, Registration> Fds;
+  std::unordered_map<Worker *, std::pair<int, int>> Watched;
+  uint32_t Serial = 0;
+  int Epoll = -1;
+  std::vector<struct pollfd> Polled;
+
+  bool Add(int const Fd, Worker *const Work, bool const Output)
+  {
+    Registration Reg{Work, ++Serial, Polled.size()};
+#ifdef HAVE_SYS_EPOLL_H
+    if (Epoll != -1)
+    {
+      struct epoll_event Event{};
+      Event.events = Output ? EPOLLOUT : EPOLLIN;
+      Event.data.u64 = (static_cast<uint64_t>(Reg.Serial) << 32) | static_cast<uint32_t>(Fd);
+      if (epoll_ctl(Epoll, EPOLL_CTL_ADD, Fd, &Event) != 0)
+        return _error->Errno("epoll_ctl", "Failed to watch file descriptor %d", Fd);
+    }
+    else
+#endif
+      Polled.push_back({Fd, static_cast<short>(Output ? POLLOUT : POLLIN), 0});
+    Fds[Fd] = Reg;
+    return true;
+  }
+  void Del(int const Fd)
+  {
+    auto const Reg = Fds.find(Fd);
+    if (Reg == Fds.end())
+      return;
+#ifdef HAVE_SYS_EPOLL_H
+    if (Epoll != -1)
+      epoll_ctl(Epoll, EPOLL_CTL_DEL, Fd, nullptr);
+    else
+#endif
+    {
+      // fill the gap with the last entry to keep the array dense
+      auto const Slot = Reg->second.Slot;
+      Polled[Slot] = Polled.back();
+      Polled.pop_back();
+      if (Slot != Polled.size())
+        Fds[Polled[Slot].fd].Slot = Slot;
+    }
+    Fds.erase(Reg);
+  }
+  bool Change(int &Current, int const Fd, Worker *const Work, bool const Output)
+  {
+    if (Current == Fd)
+      return true;
+    if (Current != -1)
+      Del(Current);
+    Current = -1;
+    if (Fd == -1)
+      return true;
+    if (Add(Fd, Work, Output) == false)
+      return false;
+    Current = Fd;
+    return true;
+  }
+
+  public:
+  /** \brief The queues have to be checked for delayed items again */
+  bool Rescan = true;
+  /** \brief The earliest time a delayed item becomes ready */
+  time_point FetchAfter{};
+  /** \brief Descriptors and serials of the last Wait() */
+  std::vector<std::pair<int, uint32_t>> Ready;
+  /** \brief The queues by their name */
+  std::unordered_map<std::string, Queue *> QueueByName;
+  /** \brief The queues named "access:…" by their access, oldest first */
+  std::unordered_map<std::string, std::vector<Queue *>> QueuesByAccess;
+  /** \brief The position of each item in Items */
+  std::unordered_map<Item *, size_t> ItemPos;
+
+  bool Watch(Worker *const Work, int const In, int const Out)
+  {
+    auto &Current = Watched[Work];
+    bool Res = Change(Current.first, In, Work, false);
+    Res &= Change(Current.second, Out, Work, true);
+    if (Current.first == -1 && Current.second == -1)
+      Watched.erase(Work);
+    return Res;
+  }
+  void Unwatch(Worker *const Work)
+  {
+    Watch(Work, -1, -1);
+  }
+  /** \brief The worker an event is for if its descriptor is still watched */
+  Worker *Owner(std::pair<int, uint32_t> const &Event) const
+  {
+    auto const Reg = Fds.find(Event.first);
+    if (Reg == Fds.end() || Reg->second.Serial != Event.second)
+      return nullptr;
+    return Reg->second.Work;
+  }
+  /** \brief Wait up to Timeout milliseconds for descriptors to become ready
+   *  \return the number of ready descriptors or -1 on error */
+  int Wait(int const Timeout)
+  {
+    Ready.clear();
+#ifdef HAVE_SYS_EPOLL_H
+    if (Epoll != -1)
+    {
+      struct epoll_event Events[64];
+      int Res;
+      do
+      {
+        Res = epoll_wait(Epoll, Events, sizeof(Events) / sizeof(Events[0]), Timeout);
+      } while (Res < 0 && errno == EINTR);
+      if (Res < 0)
+      {
+        _error->Errno("epoll_wait", "Waiting for the workers has failed");
+        return -1;
+      }
+      for (int I = 0; I < Res; ++I)
+        Ready.emplace_back(static_cast<int>(Events[I].data.u64 & 0xffffffff), Events[I].data.u64 >> 32);
+      return Res;
+    }
+#endif
+    int Res;
+    do
+    {
+      Res = poll(Polled.data(), Polled.size(), Timeout);
+    } while (Res < 0 && errno == EINTR);
+    if (Res < 0)
+    {
+      _error->Errno("poll", "Waiting for the workers has failed");
+      return -1;
+    }
+    for (auto const &P : Polled)
+      if (P.revents != 0)
+        Ready.emplace_back(P.fd, Fds[P.fd].Serial);
+    return Res;
+  }
+
+  Private()
+  {
+#ifdef HAVE_SYS_EPOLL_H
+    if (_config->FindB("Debug::NoEpoll", false) == false)
+      Epoll = epoll_create1(EPOLL_CLOEXEC);
+#endif
+  }
+  ~Private()
+  {
+    if (Epoll != -1)
+      close(Epoll);
+  }
+};
+/*}}}*/
+// Queue::Private - Indexes over the items of a queue			/*{{{*/
+// ---------------------------------------------------------------------
+/* The order of the items in the linked list matters, but with many items
+   walking it to find an item, its predecessor or the end of the list makes
+   queuing and finishing each item linear in the length of the queue. */
+class pkgAcquire::Queue::Private
+{
+  struct Entry
+  {
+    /** \brief Key of the item in #ByURI, as the URI can change */
+    std::string const *URI;
+    /** \brief The item before this one in the list (or \b nullptr) */
+    QItem *Prev;
+    /** \brief What the item added to #Backlog */
+    unsigned long long Backlog;
+  };
+  Queue *const Q;
+  std::unordered_map<QItem const *, Entry> Entries;
+
+  template <typename Map, typename Key>
+  static void Erase(Map &Index, Key const &K, QItem const *const Itm)
+  {
+    for (auto R = Index.equal_range(K); R.first != R.second; ++R.first)
+      if (R.first->second == Itm)
+      {
+        Index.erase(R.first);
+        return;
+      }
+  }
+
+  public:
+  std::unordered_multimap<std::string, QItem *> ByURI;
+  std::unordered_multimap<Item const *, QItem *> ByOwner;
+  /** \brief The last item in the queue */
+  QItem *Last = nullptr;
+  /** \brief Bytes expected to be fetched for the items in the queue */
+  unsigned long long Backlog = 0;
+
+  /** \brief Insert the item after Prev or at the front if that is \b nullptr */
+  void Link(QItem *const Itm, QItem *const Prev)
+  {
+    QItem *&Slot = Prev == nullptr ? Q->Items : Prev->Next;
+    Itm->Next = Slot;
+    Slot = Itm;
+    if (Itm->Next != nullptr)
+      Entries[Itm->Next].Prev = Itm;
+    else
+      Last = Itm;
+
+    auto const hashes = Itm->Owner->GetExpectedHashes();
+    auto const Size = hashes.empty() ? Itm->Owner->FileSize : hashes.FileSize();
+    Backlog += Size;
+    auto const Key = ByURI.emplace(Itm->URI, Itm);
+    ByOwner.emplace(Itm->Owner, Itm);
+    Entries[Itm] = Entry{&Key->first, Prev, Size};
+  }
+  /** \brief Remove the item from the list (and the indexes) */
+  void Unlink(QItem *const Itm)
+  {
+    auto const E = Entries.find(Itm);
+    QItem *const Prev = E->second.Prev;
+    (Prev == nullptr ? Q->Items : Prev->Next) = Itm->Next;
+    if (Itm->Next != nullptr)
+      Entries[Itm->Next].Prev = Prev;
+    else
+      Last = Prev;
+
+    Backlog -= E->second.Backlog;
+    Erase(ByOwner, Itm->Owner, Itm);
+    Erase(ByURI, *E->second.URI, Itm);
+    Entries.erase(E);
+  }
+
+  explicit Private(Queue *const Q) : Q(Q) {}
+};
+/*}}}*/
 std::string pkgAcquire::URIEncode(std::string const &part) /*{{{*/
 {
   // The "+" is encoded as a workaround for an S3 bug (LP#1003633 and LP#1086997)
@@ -70,13 +316,13 @@ std::string pkgAcquire::URIEncode(std::string const &part) /*{{{*/
 // Acquire::pkgAcquire - Constructor					/*{{{*/
 // ---------------------------------------------------------------------
 /* We grab some runtime state from the configuration space */
-pkgAcquire::pkgAcquire() : LockFD(-1), d(NULL), Queues(0), Workers(0), Configs(0), Log(NULL), ToFetch(0),
+pkgAcquire::pkgAcquire() : LockFD(-1), d(new Private()), Queues(0), Workers(0), Configs(0), Log(NULL), ToFetch(0),
                            Debug(_config->FindB("Debug::pkgAcquire", false)),
                            Running(false)
 {
   Initialize();
 }
-pkgAcquire::pkgAcquire(pkgAcquireStatus *Progress) : LockFD(-1), d(NULL), Queues(0), Workers(0),
+pkgAcquire::pkgAcquire(pkgAcquireStatus *Progress) : LockFD(-1), d(new Private()), Queues(0), Workers(0),
                                                      Configs(0), Log(NULL), ToFetch(0),
                                                      Debug(_config->FindB("Debug::pkgAcquire", false)),
                                                      Running(false)
@@ -198,6 +444,7 @@ pkgAcquire::~pkgAcquire()
     Configs = Configs->Next;
     delete Jnk;
   }
+  delete d;
 }
 /*}}}*/
 // Acquire::Shutdown - Clean out the acquire object			/*{{{*/
@@ -205,11 +452,16 @@ pkgAcquire::~pkgAcquire()
 /* */
 void pkgAcquire::Shutdown()
 {
-  while (Items.empty() == false)
+  // the items remove themselves from the list, which is quadratic if they
+  // are erased one by one from the front of it
+  std::vector<Item *> Doomed;
+  Doomed.swap(Items);
+  d->ItemPos.clear();
+  for (auto const I : Doomed)
   {
-    if (Items[0]->Status == Item::StatFetching)
-      Items[0]->Status = Item::StatError;
-    delete Items[0];
+    if (I->Status == Item::StatFetching)
+      I->Status = Item::StatError;
+    delete I;
   }
 
   while (Queues != 0)
@@ -218,6 +470,8 @@ void pkgAcquire::Shutdown()
     Queues = Queues->Next;
     delete Jnk;
   }
+  d->QueueByName.clear();
+  d->QueuesByAccess.clear();
 }
 /*}}}*/
 // Acquire::Add - Add a new item					/*{{{*/
@@ -226,26 +480,36 @@ void pkgAcquire::Shutdown()
    item status */
 void pkgAcquire::Add(Item *Itm)
 {
+  d->ItemPos[Itm] = Items.size();
   Items.push_back(Itm);
 }
 /*}}}*/
 // Acquire::Remove - Remove a item					/*{{{*/
 // ---------------------------------------------------------------------
-/* Remove an item from the acquire list. This is usually not used.. */
+/* Remove an item from the acquire list. This is usually not used..
+   The last item takes its place, so the order of the list changes. */
 void pkgAcquire::Remove(Item *Itm)
 {
   Dequeue(Itm);
-
-  for (ItemIterator I = Items.begin(); I != Items.end();)
+  auto const Pos = d->ItemPos.find(Itm);
+  if (unlikely(Pos == d->ItemPos.end() || Pos->second >= Items.size() || Items[Pos->second] != Itm))
   {
-    if (*I == Itm)
-    {
-      Items.erase(I);
-      I = Items.begin();
-    }
-    else
-      ++I;
+    // a subclass has changed the list behind our back (or it is empty
+    // as we are shutting down)
+    Items.erase(std::remove(Items.begin(), Items.end(), Itm), Items.end());
+    d->ItemPos.clear();
+    for (size_t I = 0; I < Items.size(); ++I)
+      d->ItemPos[Items[I]] = I;
+    return;
   }
+  size_t const I = Pos->second;
+  d->ItemPos.erase(Pos);
+  if (I + 1 != Items.size())
+  {
+    Items[I] = Items.back();
+    d->ItemPos[Items[I]] = I;
+  }
+  Items.pop_back();
 }
 /*}}}*/
 // Acquire::Add - Add a worker						/*{{{*/
@@ -268,6 +532,7 @@ void pkgAcquire::Remove(Worker *Work)
   if (Running == true)
     abort();
 
+  d->Unwatch(Work);
   Worker **I = &Workers;
   for (; *I != 0;)
   {
@@ -278,6 +543,15 @@ void pkgAcquire::Remove(Worker *Work)
   }
 }
 /*}}}*/
+// Acquire::Watch - Watch the descriptors of a worker			/*{{{*/
+// ---------------------------------------------------------------------
+/* Called by the worker whenever it starts or stops to wait for input or
+   has (no more) output pending */
+void pkgAcquire::Watch(Worker *Work)
+{
+  d->Watch(Work, Work->InReady ? Work->InFd : -1, Work->OutReady ? Work->OutFd : -1);
+}
+/*}}}*/
 // Acquire::Enqueue - Queue an URI for fetching				/*{{{*/
 // ---------------------------------------------------------------------
 /* This is the entry point for an item. An item calls this function when
@@ -340,14 +614,14 @@ void pkgAcquire::Enqueue(ItemDesc &Item)
     return;
 
   // Find the queue structure
-  Queue *I = Queues;
-  for (; I != 0 && I->Name != Name; I = I->Next)
-    ;
+  Queue *&I = d->QueueByName[Name];
   if (I == 0)
   {
     I = new Queue(Name, this);
     I->Next = Queues;
     Queues = I;
+    if (auto const Colon = Name.find(':'); Colon != string::npos)
+      d->QueuesByAccess[Name.substr(0, Colon)].push_back(I);
 
     if (Running == true)
       I->Startup();
@@ -361,6 +635,7 @@ void pkgAcquire::Enqueue(ItemDesc &Item)
   // Queue it into the named queue
   if (I->Enqueue(Item))
     ToFetch++;
+  d->Rescan = true;
 
   // Some trace stuff
   if (Debug == true)
@@ -382,7 +657,7 @@ void pkgAcquire::Dequeue(Item *Itm)
   if (Debug == true)
     clog << "Dequeuing " << Itm->DestFile << endl;
 
-  for (; I != 0; I = I->Next)
+  for (; I != 0 && Itm->QueueCounter != 0; I = I->Next)
   {
     if (I->Dequeue(Itm))
     {
@@ -394,6 +669,7 @@ void pkgAcquire::Dequeue(Item *Itm)
 
   if (Res == true)
     ToFetch--;
+  d->Rescan = true;
 }
 /*}}}*/
 // Acquire::QueueName - Return the name of the queue for this URI	/*{{{*/
@@ -422,16 +698,13 @@ string pkgAcquire::QueueName(string Uri, MethodConfig const *&Config)
   // Host-less methods like rred, store, …
   if (U.Host.empty())
   {
-    int existing = 0;
     // check how many queues exist already and reuse empty ones
     auto const AccessSchema = U.Access + ':';
-    for (Queue const *I = Queues; I != 0; I = I->Next)
-      if (APT::String::Startswith(I->Name, AccessSchema))
-      {
-        if (I->Items == nullptr)
-          return I->Name;
-        ++existing;
-      }
+    auto const &AccessQueues = d->QueuesByAccess[U.Access];
+    for (auto I = AccessQueues.crbegin(); I != AccessQueues.crend(); ++I)
+      if ((*I)->Items == nullptr)
+        return (*I)->Name;
+    int const existing = AccessQueues.size();
 
     int const Limit = _config->FindI("Acquire::QueueHost::Limit",
 #ifdef _SC_NPROCESSORS_ONLN
@@ -449,23 +722,11 @@ string pkgAcquire::QueueName(string Uri, MethodConfig const *&Config)
     // we already established that there are no empty and we can't spawn new
     Queue const *selected = nullptr;
     auto selected_backlog = std::numeric_limits<decltype(HashStringList().FileSize())>::max();
-    for (Queue const *Q = Queues; Q != nullptr; Q = Q->Next)
-      if (APT::String::Startswith(Q->Name, AccessSchema))
+    for (auto Q = AccessQueues.crbegin(); Q != AccessQueues.crend(); ++Q)
+      if ((*Q)->d->Backlog < selected_backlog)
       {
-        decltype(selected_backlog) current_backlog = 0;
-        for (auto const *I = Q->Items; I != nullptr; I = I->Next)
-        {
-          auto const hashes = I->Owner->GetExpectedHashes();
-          if (not hashes.empty())
-            current_backlog += hashes.FileSize();
-          else
-            current_backlog += I->Owner->FileSize;
-        }
-        if (current_backlog < selected_backlog)
-        {
-          selected = Q;
-          selected_backlog = current_backlog;
-        }
+        selected = *Q;
+        selected_backlog = (*Q)->d->Backlog;
       }
 
     if (unlikely(selected == nullptr))
@@ -477,16 +738,12 @@ string pkgAcquire::QueueName(string Uri, MethodConfig const *&Config)
   {
     auto const FullQueueName = U.Access + ':' + U.Host;
     // if the queue already exists, re-use it
-    for (Queue const *Q = Queues; Q != nullptr; Q = Q->Next)
-      if (Q->Name == FullQueueName)
-        return FullQueueName;
+    if (d->QueueByName.find(FullQueueName) != d->QueueByName.end())
+      return FullQueueName;
 
-    int existing = 0;
-    // check how many queues exist already and reuse empty ones
-    auto const AccessSchema = U.Access + ':';
-    for (Queue const *Q = Queues; Q != nullptr; Q = Q->Next)
-      if (APT::String::Startswith(Q->Name, AccessSchema))
-        ++existing;
+    // check how many queues exist already
+    auto const Q = d->QueuesByAccess.find(U.Access);
+    int const existing = Q == d->QueuesByAccess.end() ? 0 : Q->second.size();
 
     int const Limit = _config->FindI("Acquire::QueueHost::Limit", DEFAULT_HOST_LIMIT);
     // if we have too many hosts open use a single generic for the rest
@@ -714,69 +971,78 @@ pkgAcquire::RunResult pkgAcquire::Run(int PulseInterval)
   bool WasCancelled = false;
 
   // Run till all things have been acquired
-  struct timeval tv = SteadyDurationToTimeVal(std::chrono::microseconds(PulseInterval));
+  auto const Interval = std::chrono::microseconds(PulseInterval);
+  auto NextPulse = clock::now() + Interval;
+  d->Rescan = true;
   while (ToFetch > 0)
   {
-    fd_set RFds;
-    fd_set WFds;
-    int Highest = 0;
-    FD_ZERO(&RFds);
-    FD_ZERO(&WFds);
-    SetFds(Highest, &RFds, &WFds);
-
-    // Shorten the select() cycle in case we have items about to become ready
+    /* Shorten the wait in case we have items about to become ready. The
+       queues only need to be looked at again if they have changed or an
+       item might have become ready. */
     auto now = clock::now();
-    auto fetchAfter = time_point{};
-    for (Queue *I = Queues; I != nullptr; I = I->Next)
+    if (d->Rescan == true)
     {
-      if (I->Items == nullptr)
-        continue;
+      d->Rescan = false;
+      d->FetchAfter = time_point{};
+      for (Queue *I = Queues; I != nullptr; I = I->Next)
+      {
+        if (I->Items == nullptr)
+          continue;
 
-      auto f = I->Items->GetFetchAfter();
+        auto f = I->Items->GetFetchAfter();
 
-      if (f == time_point() || I->Items->Owner->Status != pkgAcquire::Item::StatIdle)
-        continue;
+        if (f == time_point() || I->Items->Owner->Status != pkgAcquire::Item::StatIdle)
+          continue;
 
-      if (f <= now)
-      {
-        if (not I->Cycle()) // Queue got stuck, unstuck it.
-          goto stop;
-        fetchAfter = now; // need to time out in select() below
-        if (I->Items->Owner->Status == pkgAcquire::Item::StatIdle)
+        if (f <= now)
         {
-          _error->Warning("Tried to start delayed item %s, but failed", I->Items->Description.c_str());
+          if (not I->Cycle()) // Queue got stuck, unstuck it.
+            goto stop;
+          d->FetchAfter = now; // need to time out in Wait() below
+          if (I->Items->Owner->Status == pkgAcquire::Item::StatIdle)
+          {
+            _error->Warning("Tried to start delayed item %s, but failed", I->Items->Description.c_str());
+          }
+        }
+        else if (f < d->FetchAfter || d->FetchAfter == time_point{})
+        {
+          d->FetchAfter = f;
         }
-      }
-      else if (f < fetchAfter || fetchAfter == time_point{})
-      {
-        fetchAfter = f;
       }
     }
 
-    if (fetchAfter != time_point{} && (fetchAfter - now) < std::chrono::seconds(tv.tv_sec) + std::chrono::microseconds(tv.tv_usec))
-    {
-      tv = SteadyDurationToTimeVal(fetchAfter - now);
-    }
-
-    int Res;
-    do
-    {
-      Res = select(Highest + 1, &RFds, &WFds, 0, &tv);
-    } while (Res < 0 && errno == EINTR);
+    auto Deadline = NextPulse;
+    if (d->FetchAfter != time_point{} && d->FetchAfter < Deadline)
+      Deadline = d->FetchAfter;
+    int Timeout = 0;
+    if (Deadline > now)
+      Timeout = std::chrono::ceil<std::chrono::milliseconds>(Deadline - now).count();
 
+    int const Res = d->Wait(Timeout);
     if (Res < 0)
-    {
-      _error->Errno("select", "Select has failed");
       break;
-    }
 
-    if (RunFds(&RFds, &WFds) == false)
+    // Dispatch the events to the workers. The owner is looked up for each
+    // event as handling an earlier one can have closed the descriptor.
+    bool Okay = true;
+    for (auto const &Event : d->Ready)
+    {
+      Worker *const Work = d->Owner(Event);
+      if (Work == nullptr)
+        continue;
+      if (Event.first == Work->InFd)
+        Okay &= Work->InFdReady();
+      else if (Event.first == Work->OutFd)
+        Okay &= Work->OutFdReady();
+    }
+    if (Okay == false)
       break;
 
     // Timeout, notify the log class
     if (Res == 0 || (Log != 0 && Log->Update == true))
     {
-      tv = SteadyDurationToTimeVal(std::chrono::microseconds(PulseInterval));
+      NextPulse = clock::now() + Interval;
+      d->Rescan = true;
 
       for (Worker *I = Workers; I != 0; I = I->NextAcquire)
         I->Pulse();
@@ -817,6 +1083,7 @@ void pkgAcquire::Bump()
 {
   for (Queue *I = Queues; I != 0; I = I->Next)
     I->Bump();
+  d->Rescan = true;
 }
 /*}}}*/
 // Acquire::WorkerStep - Step to the next worker			/*{{{*/
@@ -992,7 +1259,7 @@ void pkgAcquire::MethodConfig::SetSendURIEncoded(bool const value) /*{{{*/
 // Queue::Queue - Constructor						/*{{{*/
 // ---------------------------------------------------------------------
 /* */
-pkgAcquire::Queue::Queue(string const &name, pkgAcquire *const owner) : d(NULL), Next(0),
+pkgAcquire::Queue::Queue(string const &name, pkgAcquire *const owner) : d(new Private(this)), Next(0),
                                                                         Name(name), Items(0), Workers(0), Owner(owner), PipeDepth(0), MaxPipeDepth(1)
 {
 }
@@ -1010,6 +1277,7 @@ pkgAcquire::Queue::~Queue()
     Items = Items->Next;
     delete Jnk;
   }
+  delete d;
 }
 /*}}}*/
 // Queue::Enqueue - Queue an item to the queue				/*{{{*/
@@ -1035,37 +1303,40 @@ bool pkgAcquire::Queue::Enqueue(ItemDesc &Item)
     }
     return true;
   };
-  QItem **OptimalI = &Items;
-  QItem **I = &Items;
-  auto insertLocation = std::make_tuple(Item.Owner->FetchAfter(), -Item.Owner->Priority());
-  // move to the end of the queue and check for duplicates here
-  for (; *I != 0;)
+  // check for duplicates
+  for (auto R = d->ByURI.equal_range(Item.URI); R.first != R.second; ++R.first)
   {
-    if (Item.URI == (*I)->URI && MetaKeysMatch(Item, *I))
+    QItem *const I = R.first->second;
+    if (Item.URI == I->URI && MetaKeysMatch(Item, I))
     {
       if (_config->FindB("Debug::pkgAcquire::Worker", false) == true)
-        std::cerr << " @ Queue: Action combined for " << Item.URI << " and " << (*I)->URI << std::endl;
-      (*I)->Owners.push_back(Item.Owner);
-      Item.Owner->Status = (*I)->Owner->Status;
+        std::cerr << " @ Queue: Action combined for " << Item.URI << " and " << I->URI << std::endl;
+      I->Owners.push_back(Item.Owner);
+      Item.Owner->Status = I->Owner->Status;
       return false;
     }
-    // Determine the optimal position to insert: before anything with a
-    // higher priority.
-    auto queueLocation = std::make_tuple((*I)->GetFetchAfter(),
-                                         -(*I)->GetPriority());
+  }
 
-    I = &(*I)->Next;
-    if (queueLocation <= insertLocation)
-    {
-      OptimalI = I;
-    }
+  // Determine the optimal position to insert: before anything with a
+  // higher priority. Usually that is the end of the queue.
+  auto const Location = [](QItem const *const I)
+  {
+    return std::make_tuple(I->GetFetchAfter(), -I->GetPriority());
+  };
+  auto insertLocation = std::make_tuple(Item.Owner->FetchAfter(), -Item.Owner->Priority());
+  QItem *Prev = d->Last;
+  if (Prev != nullptr && insertLocation < Location(Prev))
+  {
+    Prev = nullptr;
+    for (QItem *I = Items; I != nullptr; I = I->Next)
+      if (Location(I) <= insertLocation)
+        Prev = I;
   }
 
   // Create a new item
   QItem *Itm = new QItem;
   *Itm = Item;
-  Itm->Next = *OptimalI;
-  *OptimalI = Itm;
+  d->Link(Itm, Prev);
 
   Item.Owner->QueueCounter++;
   if (Items->Next == 0)
@@ -1081,24 +1352,21 @@ bool pkgAcquire::Queue::Dequeue(Item *Owner)
   if (Owner->Status == pkgAcquire::Item::StatFetching)
     return _error->Error("Tried to dequeue a fetching object");
 
-  bool Res = false;
+  auto R = d->ByOwner.equal_range(Owner);
+  if (R.first == R.second)
+    return false;
 
-  QItem **I = &Items;
-  for (; *I != 0;)
+  std::vector<QItem *> Jnk;
+  for (; R.first != R.second; ++R.first)
+    Jnk.push_back(R.first->second);
+  for (auto const I : Jnk)
   {
-    if (Owner == (*I)->Owner)
-    {
-      QItem *Jnk = *I;
-      *I = (*I)->Next;
-      Owner->QueueCounter--;
-      delete Jnk;
-      Res = true;
-    }
-    else
-      I = &(*I)->Next;
+    d->Unlink(I);
+    Owner->QueueCounter--;
+    delete I;
   }
 
-  return Res;
+  return true;
 }
 /*}}}*/
 // Queue::Startup - Start the worker processes				/*{{{*/
@@ -1172,9 +1440,9 @@ pkgAcquire::Queue::QItem *pkgAcquire::Queue::FindItem(string URI, pkgAcquire::Wo
 {
   if (Owner->Config->GetSendURIEncoded())
   {
-    for (QItem *I = Items; I != nullptr; I = I->Next)
-      if (I->URI == URI && I->Worker == Owner)
-        return I;
+    for (auto R = d->ByURI.equal_range(URI); R.first != R.second; ++R.first)
+      if (R.first->second->URI == URI && R.first->second->Worker == Owner)
+        return R.first->second;
   }
   else
   {
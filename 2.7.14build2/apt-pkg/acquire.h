@@ -98,8 +98,9 @@ class APT_PUBLIC pkgAcquire
   using time_point = std::chrono::time_point<clock>;
   /** \brief FD of the Lock file we acquire in Setup (if any) */
   int LockFD;
-  /** \brief dpointer placeholder (for later in case we need it) */
-  void *const d;
+  /** \brief The event loop watching the file descriptors of the workers */
+  class Private;
+  Private *const d;
 
   public:
   class Item;
@@ -215,6 +216,10 @@ class APT_PUBLIC pkgAcquire
    *  The default implementation inserts the file descriptors
    *  corresponding to active downloads.
    *
+   *  \deprecated Run() does not call this anymore, but watches the
+   *  workers with epoll(7) (or poll(2)) instead, so overriding it has
+   *  no effect.
+   *
    *  \param[out] Fd The largest file descriptor in the generated sets.
    *
    *  \param[out] RSet The set of file descriptors that should be
@@ -223,12 +228,15 @@ class APT_PUBLIC pkgAcquire
    *  \param[out] WSet The set of file descriptors that should be
    *  watched for output.
    */
+  APT_DEPRECATED_MSG("Run() watches the workers itself, so this is not called anymore")
   virtual void SetFds(int &Fd, fd_set *RSet, fd_set *WSet);
 
   /** Handle input from and output to file descriptors which select()
    *  has determined are ready.  The default implementation
    *  dispatches to all active downloads.
    *
+   *  \deprecated Run() does not call this anymore, see SetFds().
+   *
    *  \param RSet The set of file descriptors that are ready for
    *  input.
    *
@@ -237,8 +245,17 @@ class APT_PUBLIC pkgAcquire
    *
    * \return false if there is an error condition on one of the fds
    */
+  APT_DEPRECATED_MSG("Run() watches the workers itself, so this is not called anymore")
   virtual bool RunFds(fd_set *RSet, fd_set *WSet);
 
+  /** \brief Watch the file descriptors of the given worker (again).
+   *
+   *  Called by the worker each time it starts or stops waiting for
+   *  input or output, so that Run() only needs to look at workers
+   *  with activity.
+   */
+  APT_HIDDEN void Watch(Worker *Work);
+
   /** \brief Check for idle queues with ready-to-fetch items.
    *
    *  Called by pkgAcquire::Queue::Done each time an item is dequeued
@@ -409,8 +426,9 @@ class APT_PUBLIC pkgAcquire::Queue
   friend class pkgAcquire::UriIterator;
   friend class pkgAcquire::Worker;
 
-  /** \brief dpointer placeholder (for later in case we need it) */
-  void *const d;
+  /** \brief Indexes over the items in this queue */
+  class Private;
+  Private *const d;
 
   /** \brief The next queue in the pkgAcquire object's list of queues. */
   Queue *Next;
@@ -1497,36 +1497,41 @@ namespace KernelAutoRemoveHelper
 {
 
 // \brief Returns the uname from a kernel package name, or "" for non-kernel packages.
-std::string getUname(std::string const &packageName)
+std::string getUname(APT::StringView const packageName)
 {
+  // called for each package while building the cache, so avoid any temporary strings
+  auto const Endswith = [&](APT::StringView const ending) {
+    return packageName.length() >= ending.length() &&
+           packageName.substr(packageName.length() - ending.length()) == ending;
+  };
 
-  static const constexpr char *const prefixes[] = {
-     "linux-image-",
-     "kfreebsd-image-",
-     "gnumach-image-",
+  static const constexpr APT::StringView prefixes[] = {
+     "linux-image-"_sv,
+     "kfreebsd-image-"_sv,
+     "gnumach-image-"_sv,
   };
 
   for (auto prefix : prefixes)
   {
-    if (likely(not APT::String::Startswith(packageName, prefix)))
+    if (likely(packageName.substr(0, prefix.length()) != prefix))
       continue;
-    if (unlikely(APT::String::Endswith(packageName, "-dbgsym")))
+    if (unlikely(Endswith("-dbgsym"_sv)))
       continue;
-    if (unlikely(APT::String::Endswith(packageName, "-dbg")))
+    if (unlikely(Endswith("-dbg"_sv)))
       continue;
 
-    auto aUname = packageName.substr(strlen(prefix));
+    auto const aUname = packageName.substr(prefix.length());
 
     // aUname must start with [0-9]+\.
     if (aUname.length() < 2)
       continue;
-    if (strchr("0123456789", aUname[0]) == nullptr)
-      continue;
-    auto dot = aUname.find_first_not_of("0123456789");
-    if (dot == aUname.npos || aUname[dot] != '.')
+    size_t dot = 0;
+    while (dot < aUname.length() && aUname[dot] >= '0' && aUname[dot] <= '9')
+      ++dot;
+    if (dot == 0 || dot == aUname.length() || aUname[dot] != '.')
       continue;
 
-    return aUname;
+    return aUname.to_string();
   }
 
   return "";
@@ -33,6 +33,7 @@
 #include <apt-pkg/depcache.h>
 #include <apt-pkg/packagemanager.h>
 #include <apt-pkg/pkgcache.h>
+#include <apt-pkg/string_view.h>
 
 #include <iostream>
 #include <memory>
@@ -165,7 +166,7 @@ namespace KernelAutoRemoveHelper
 // Public for linking to apt-private, but no A{P,B}I guarantee.
 APT_PUBLIC std::unique_ptr<APT::CacheFilter::Matcher> GetProtectedKernelsFilter(pkgCache *cache, bool returnRemove = false);
 std::string GetProtectedKernelsRegex(pkgCache *cache, bool ReturnRemove = false);
-std::string getUname(std::string const &packageName);
+std::string getUname(APT::StringView const packageName);
 
 } // namespace KernelAutoRemoveHelper
 
@@ -122,7 +122,7 @@ std::vector<std::string> const Configuration::getCompressionTypes(bool const &Ca
 
   for (; Types != 0; Types = Types->Next)
   {
-    if (Types->Tag == "Order" || Types->Tag.empty() == true)
+    if (Types->Tag == "Order" || Types->Tag == "Adaptive" || Types->Tag.empty() == true)
       continue;
     // ignore types we already have in the vector
     if (std::find(types.begin(), types.end(), Types->Tag) != types.end())
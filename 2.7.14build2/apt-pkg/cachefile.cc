@@ -306,6 +306,12 @@ static void SetCacheStartBeforeRemovingCache(std::string const &cache)
   struct stat Buf;
   if (stat(cache.c_str(), &Buf) == 0 && (Buf.st_mode & S_IFREG) != 0)
   {
+    {
+      _error->PushToStack();
+      FileFd CacheFile(cache, FileFd::ReadOnly, FileFd::None);
+      pkgCacheGenerator::RememberCacheSize(CacheFile);
+      _error->RevertToStack();
+    }
     RemoveFile("RemoveCaches", cache);
     if (CacheStart == 0 && std::numeric_limits<decltype(CacheStart)>::max() >= Buf.st_size && Buf.st_size > CacheStartDefault)
       _config->Set("APT::Cache-Start", Buf.st_size);
@@ -14,10 +14,14 @@
 #include <apt-pkg/configuration.h>
 #include <apt-pkg/error.h>
 #include <apt-pkg/fileutl.h>
+#include <apt-pkg/hashes.h>
 #include <apt-pkg/pkgcache.h>
 #include <apt-pkg/strutl.h>
+#include <apt-pkg/tagfile.h>
 
 #include <cstring>
+#include <locale>
+#include <sstream>
 #include <string>
 #include <dirent.h>
 #include <fcntl.h>
@@ -129,9 +133,169 @@ bool pkgArchiveCleaner::Go(std::string Dir, pkgCache &Cache)
     Erase(dirfd, Dir->d_name, Pkg, Ver, St);
   }
   closedir(D);
+
+  // forget the hashes of the files erased
+  if (RealFileExists(flCombine(Dir, "hashes")))
+    pkgArchiveHashes(Dir).Compact();
   return true;
 }
 /*}}}*/
 
 pkgArchiveCleaner::pkgArchiveCleaner() : d(NULL) {}
 pkgArchiveCleaner::~pkgArchiveCleaner() {}
+
+// ArchiveHashes - hashes of files verified before			/*{{{*/
+/* A file in the archive directory was verified when it was downloaded,
+   but on later runs only its size was compared with the one the index
+   expects. Remembering the hashes it was verified with allows comparing
+   them as well without reading the file again. */
+pkgArchiveHashes::pkgArchiveHashes(std::string D) : Dir(std::move(D))
+{
+  if (Dir.empty() == false && Dir.back() != '/')
+    Dir.push_back('/');
+}
+pkgArchiveHashes::Entry pkgArchiveHashes::Identify(struct stat const &St)
+{
+  Entry E;
+  E.Device = St.st_dev;
+  E.Inode = St.st_ino;
+  E.Size = St.st_size;
+  E.MTime = St.st_mtim.tv_sec * 1000000000ull + St.st_mtim.tv_nsec;
+  E.CTime = St.st_ctim.tv_sec * 1000000000ull + St.st_ctim.tv_nsec;
+  return E;
+}
+bool pkgArchiveHashes::Same(Entry const &A, Entry const &B)
+{
+  return A.Device == B.Device && A.Inode == B.Inode && A.Size == B.Size &&
+         A.MTime == B.MTime && A.CTime == B.CTime;
+}
+void pkgArchiveHashes::Load()
+{
+  if (Loaded)
+    return;
+  Loaded = true;
+  std::string const File = Dir + "hashes";
+  if (RealFileExists(File) == false)
+    return;
+  // the file is only an optimisation, so nothing in it is an error
+  _error->PushToStack();
+  FileFd Fd;
+  if (Fd.Open(File, FileFd::ReadOnly))
+  {
+    pkgTagFile Tags(&Fd);
+    pkgTagSection Section;
+    while (Tags.Step(Section))
+    {
+      ++Stanzas;
+      std::string const Name = Section.FindS("Filename");
+      if (Name.empty() || Name.find('/') != std::string::npos)
+        continue;
+      // a stanza without identity revokes the entry
+      if (Section.Exists("Inode") == false)
+      {
+        Entries.erase(Name);
+        continue;
+      }
+      Entry E;
+      E.Device = Section.FindULL("Device");
+      E.Inode = Section.FindULL("Inode");
+      E.Size = Section.FindULL("Size");
+      E.MTime = Section.FindULL("Modification-Time");
+      E.CTime = Section.FindULL("Change-Time");
+      for (char const **Type = HashString::SupportedHashes(); *Type != nullptr; ++Type)
+      {
+        std::string const Value = Section.FindS(*Type);
+        if (Value.empty() == false)
+          E.Hashes.push_back(HashString(*Type, Value));
+      }
+      E.Hashes.FileSize(E.Size);
+      Entries[Name] = std::move(E);
+    }
+  }
+  _error->RevertToStack();
+
+  // entries of files changed or gone since are of no use
+  for (auto E = Entries.begin(); E != Entries.end();)
+  {
+    struct stat St;
+    if (stat((Dir + E->first).c_str(), &St) != 0 || Same(E->second, Identify(St)) == false)
+      E = Entries.erase(E);
+    else
+      ++E;
+  }
+  if (Stanzas > 2 * Entries.size() + 64)
+    Compact();
+}
+void pkgArchiveHashes::Append(std::string const &Stanza)
+{
+  int const Fd = open((Dir + "hashes").c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (Fd == -1)
+    return;
+  _error->PushToStack();
+  // with a single write, concurrent appends can't interleave
+  if (FileFd::Write(Fd, Stanza.c_str(), Stanza.length()))
+    ++Stanzas;
+  _error->RevertToStack();
+  close(Fd);
+}
+std::string pkgArchiveHashes::Stanza(std::string const &Name, Entry const *const E)
+{
+  std::ostringstream Out;
+  Out.imbue(std::locale::classic());
+  Out << "Filename: " << Name << '\n';
+  if (E != nullptr)
+  {
+    Out << "Device: " << E->Device << "\nInode: " << E->Inode << "\nSize: " << E->Size
+        << "\nModification-Time: " << E->MTime << "\nChange-Time: " << E->CTime << '\n';
+    for (auto const &Hash : E->Hashes)
+      if (Hash.HashType() != "Checksum-FileSize")
+        Out << Hash.HashType() << ": " << Hash.HashValue() << '\n';
+  }
+  Out << '\n';
+  return Out.str();
+}
+HashStringList pkgArchiveHashes::Find(std::string const &File, struct stat const &St)
+{
+  Load();
+  auto const E = Entries.find(flNotDir(File));
+  if (E == Entries.end() || Same(E->second, Identify(St)) == false)
+    return {};
+  return E->second.Hashes;
+}
+void pkgArchiveHashes::Add(std::string const &File, HashStringList const &Hashes)
+{
+  struct stat St;
+  if (Hashes.empty() || stat(File.c_str(), &St) != 0)
+    return;
+  Load();
+  Entry E = Identify(St);
+  E.Hashes = Hashes;
+  E.Hashes.FileSize(E.Size);
+  Append(Stanza(flNotDir(File), &E));
+  Entries[flNotDir(File)] = std::move(E);
+}
+void pkgArchiveHashes::Forget(std::string const &File)
+{
+  Load();
+  if (Entries.erase(flNotDir(File)) != 0)
+    Append(Stanza(flNotDir(File), nullptr));
+}
+bool pkgArchiveHashes::Compact()
+{
+  Load();
+  if (Stanzas == Entries.size())
+    return true;
+  std::string Content;
+  for (auto const &E : Entries)
+    Content.append(Stanza(E.first, &E.second));
+  _error->PushToStack();
+  FileFd Fd(Dir + "hashes", FileFd::WriteAtomic, 0644);
+  bool const Res = Fd.Write(Content.c_str(), Content.length()) && Fd.Close();
+  if (Res == false)
+    Fd.OpFail();
+  _error->RevertToStack();
+  if (Res)
+    Stanzas = Entries.size();
+  return Res;
+}
+/*}}}*/
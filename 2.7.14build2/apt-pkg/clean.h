@@ -13,6 +13,12 @@
 
 #include <apt-pkg/macros.h>
 
+#ifdef APT_COMPILING_APT
+#include <apt-pkg/hashes.h>
+
+#include <unordered_map>
+#endif
+
 class pkgCache;
 
 class APT_PUBLIC pkgArchiveCleaner
@@ -32,4 +38,50 @@ class APT_PUBLIC pkgArchiveCleaner
   virtual ~pkgArchiveCleaner();
 };
 
+#ifdef APT_COMPILING_APT
+/** \brief hashes of the files in an archive directory verified before
+ *
+ * Files are recognized by device, inode, size, modification and change
+ * time, so a file changed in any way since is unknown again. The entries
+ * are kept in the file "hashes" in the directory; new ones are appended
+ * and the pkgArchiveCleaner drops those of files erased or changed.
+ */
+class APT_HIDDEN pkgArchiveHashes
+{
+  struct Entry
+  {
+    unsigned long long Device;
+    unsigned long long Inode;
+    unsigned long long Size;
+    unsigned long long MTime;
+    unsigned long long CTime;
+    HashStringList Hashes;
+  };
+  std::string Dir;
+  std::unordered_map<std::string, Entry> Entries;
+  // stanzas in the file, including those superseded by later ones
+  size_t Stanzas = 0;
+  bool Loaded = false;
+
+  static Entry Identify(struct stat const &St);
+  static bool Same(Entry const &A, Entry const &B);
+  static std::string Stanza(std::string const &Name, Entry const *E);
+  void Load();
+  void Append(std::string const &Stanza);
+
+  public:
+  /** \return hashes the file had when it was verified if it is unchanged */
+  HashStringList Find(std::string const &File, struct stat const &St);
+  /** \brief remember the verified hashes of the file */
+  void Add(std::string const &File, HashStringList const &Hashes);
+  /** \brief do not trust the hashes recorded for the file anymore */
+  void Forget(std::string const &File);
+  /** \brief rewrite the file with only the entries still valid */
+  bool Compact();
+
+  std::string const &Directory() const { return Dir; }
+  explicit pkgArchiveHashes(std::string Dir);
+};
+#endif
+
 #endif
@@ -203,6 +203,16 @@ bool GlobalError::PopMessage(std::string &Text)
   return Ret;
 }
 /*}}}*/
+// GlobalError::PopMessage - Pulls a single message and its type out	/*{{{*/
+bool GlobalError::PopMessage(std::string &Text, MsgType &Type)
+{
+  if (Messages.empty() == true)
+    return false;
+  Type = Messages.front().Type;
+  PopMessage(Text);
+  return true;
+}
+/*}}}*/
 // GlobalError::DumpErrors - Dump all of the errors/warns to cerr	/*{{{*/
 void GlobalError::DumpErrors(std::ostream &out, MsgType const &threshold,
                              bool const &mergeStack)
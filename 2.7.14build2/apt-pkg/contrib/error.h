@@ -251,6 +251,15 @@ class APT_PUBLIC GlobalError /*{{{*/
    */
   bool PopMessage(std::string &Text);
 
+  /** \brief returns and removes the first message in the list
+   *
+   *  \param[out] Text message of the first item
+   *  \param[out] Type type of the first item, e.g. to insert it elsewhere
+   *
+   *  \return \b true if there was a message, \b false otherwise
+   */
+  bool PopMessage(std::string &Text, MsgType &Type);
+
   /** \brief clears the list of messages */
   void Discard();
 
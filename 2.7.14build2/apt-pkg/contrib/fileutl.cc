@@ -37,6 +37,7 @@
 
 #include <cctype>
 #include <cerrno>
+#include <climits>
 #include <csignal>
 #include <cstdarg>
 #include <cstddef>
@@ -52,15 +53,25 @@
 #include <glob.h>
 #include <grp.h>
 #include <pwd.h>
+#include <sys/ioctl.h>
 #include <sys/select.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
 #include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <iterator>
 #include <memory>
+#include <mutex>
 #include <set>
+#include <system_error>
+#include <thread>
+#include <tuple>
+#include <utility>
 
 #ifdef HAVE_ZLIB
 #include <zlib.h>
@@ -86,6 +97,9 @@
 #if __gnu_linux__
 #include <sys/prctl.h>
 #endif
+#ifdef HAVE_LINUX_FS_H
+#include <linux/fs.h>
+#endif
 
 #include <apti18n.h>
 /*}}}*/
@@ -166,6 +180,43 @@ bool RunScripts(const char *Cnf)
 }
 /*}}}*/
 
+// KernelCopyFile - Let the kernel copy plain files			/*{{{*/
+/* Filesystems like btrfs and XFS can share the data of the whole file
+   instead of copying it, others at least copy it without passing it
+   through userspace. Whatever is left to copy if this returns false is
+   copied by the caller from the current positions on. */
+static bool KernelCopyFile(FileFd &From, FileFd &To)
+{
+  if (From.IsCompressed() || To.IsCompressed() || To.Flush() == false)
+    return false;
+  struct stat FromBuf, ToBuf;
+  // files in /proc and co claim to be empty, which the kernel believes
+  if (fstat(From.Fd(), &FromBuf) != 0 || S_ISREG(FromBuf.st_mode) == false || FromBuf.st_size == 0 ||
+      fstat(To.Fd(), &ToBuf) != 0 || S_ISREG(ToBuf.st_mode) == false)
+    return false;
+  // data read ahead by FileFd isn't at the position of the descriptor
+  off_t const FromPos = lseek(From.Fd(), 0, SEEK_CUR);
+  if (FromPos < 0 || static_cast<unsigned long long>(FromPos) != From.Tell())
+    return false;
+
+#ifdef FICLONE
+  if (FromPos == 0 && ToBuf.st_size == 0 && lseek(To.Fd(), 0, SEEK_CUR) == 0 &&
+      ioctl(To.Fd(), FICLONE, From.Fd()) == 0)
+    return lseek(From.Fd(), 0, SEEK_END) >= 0 && lseek(To.Fd(), 0, SEEK_END) >= 0;
+#endif
+#ifdef HAVE_COPY_FILE_RANGE
+  while (true)
+  {
+    ssize_t const Res = copy_file_range(From.Fd(), nullptr, To.Fd(), nullptr, SSIZE_MAX, 0);
+    if (Res == 0)
+      return true;
+    else if (Res < 0 && errno != EINTR)
+      return false;
+  }
+#endif
+  return false;
+}
+/*}}}*/
 // CopyFile - Buffered copy of a file					/*{{{*/
 // ---------------------------------------------------------------------
 /* The caller is expected to set things so that failure causes erasure */
@@ -175,6 +226,9 @@ bool CopyFile(FileFd &From, FileFd &To)
       From.Failed() == true || To.Failed() == true)
     return false;
 
+  if (KernelCopyFile(From, To))
+    return true;
+
   // Buffered copy between fds
   constexpr size_t BufSize = APT_BUFFER_SIZE;
   std::unique_ptr<unsigned char[]> Buf(new unsigned char[BufSize]);
@@ -1104,6 +1158,7 @@ struct APT_HIDDEN simple_buffer
 class APT_HIDDEN FileFdPrivate
 { /*{{{*/
   friend class BufferedWriteFileFdPrivate;
+  friend class ReadAheadFileFdPrivate;
 
   protected:
   FileFd *const filefd;
@@ -1211,6 +1266,11 @@ class APT_HIDDEN FileFdPrivate
     return true;
   }
   virtual ssize_t InternalWrite(void const *const From, unsigned long long const Size) = 0;
+  virtual ssize_t InternalWriteV(struct iovec const *const Vec, int const /*Count*/)
+  {
+    // FileFd::Write continues with the other pieces
+    return InternalWrite(Vec[0].iov_base, Vec[0].iov_len);
+  }
   virtual bool InternalWriteError() { return filefd->FileFdErrno("write", _("Write error")); }
   virtual bool InternalSeek(unsigned long long const To)
   {
@@ -1398,6 +1458,20 @@ class APT_HIDDEN BufferedWriteFileFdPrivate : public FileFdPrivate
 
     return written;
   }
+  virtual ssize_t InternalWriteV(struct iovec const *const Vec, int const Count) APT_OVERRIDE
+  {
+    ssize_t Written = 0;
+    for (int I = 0; I < Count; ++I)
+    {
+      ssize_t const Res = InternalWrite(Vec[I].iov_base, Vec[I].iov_len);
+      if (Res < 0)
+        return Written != 0 ? Written : Res;
+      Written += Res;
+      if (static_cast<size_t>(Res) != Vec[I].iov_len)
+        break;
+    }
+    return Written;
+  }
   virtual bool InternalWriteError() APT_OVERRIDE
   {
     return wrapped->InternalWriteError();
@@ -1446,6 +1520,319 @@ class APT_HIDDEN BufferedWriteFileFdPrivate : public FileFdPrivate
   }
 };
 /*}}}*/
+class APT_HIDDEN ReadAheadFileFdPrivate : public FileFdPrivate
+{ /*{{{*/
+  /* A thread decompresses ahead into a ring of chunks while the data read
+     before is processed. Anything but reading the data in order stops the
+     thread and works on the wrapped file directly. */
+  FileFdPrivate *wrapped;
+  struct Chunk
+  {
+    std::unique_ptr<char[]> Data;
+    unsigned long long Size;
+    unsigned long long Used;
+  };
+  static constexpr unsigned long long ChunkSize = 128 * 1024;
+  std::vector<Chunk> Ring;
+  // the chunk read next, and how many are filled from there on
+  size_t Head;
+  size_t Filled;
+  bool Ended;
+  bool Failed;
+  bool Stopping;
+  // the thread (or anything else) works on the wrapped file directly
+  bool Direct;
+  // position of the data handed out, the wrapped file is Unread() ahead
+  unsigned long long Consumed;
+  int FailedErrno;
+  std::vector<std::pair<GlobalError::MsgType, std::string>> Messages;
+  std::mutex Lock;
+  std::condition_variable Changed;
+  std::thread Reader;
+  // tuning statistics for Debug::ReadAhead
+  unsigned long long ReaderStalls;
+  unsigned long long ConsumerStalls;
+  std::chrono::steady_clock::duration ConsumerStallTime;
+
+  void Read()
+  {
+    std::unique_lock<std::mutex> Guard(Lock);
+    while (true)
+    {
+      if (Filled == Ring.size() && Stopping == false)
+      {
+        ++ReaderStalls;
+        Changed.wait(Guard, [&]
+                     { return Filled != Ring.size() || Stopping; });
+      }
+      if (Stopping)
+        return;
+      Chunk &C = Ring[(Head + Filled) % Ring.size()];
+      Guard.unlock();
+
+      C.Size = C.Used = 0;
+      ssize_t Res = 0;
+      do
+      {
+        errno = 0;
+        Res = wrapped->InternalRead(C.Data.get() + C.Size, ChunkSize - C.Size);
+        if (Res > 0)
+          C.Size += Res;
+      } while ((Res > 0 || (Res < 0 && errno == EINTR)) && C.Size < ChunkSize);
+      int const ReadErrno = errno;
+      std::vector<std::pair<GlobalError::MsgType, std::string>> ReadMessages;
+      std::string Text;
+      GlobalError::MsgType Type;
+      while (_error->PopMessage(Text, Type))
+        ReadMessages.emplace_back(Type, Text);
+
+      Guard.lock();
+      if (C.Size != 0)
+        ++Filled;
+      if (Res < 0)
+      {
+        Failed = true;
+        FailedErrno = ReadErrno;
+        std::move(ReadMessages.begin(), ReadMessages.end(), std::back_inserter(Messages));
+      }
+      else if (Res == 0)
+        Ended = true;
+      Changed.notify_all();
+      if (Failed || Ended)
+        return;
+    }
+  }
+  /** \brief stop the thread, but keep the chunks it read */
+  void Stop()
+  {
+    if (Reader.joinable() == false)
+      return;
+    {
+      std::lock_guard<std::mutex> Guard(Lock);
+      Stopping = true;
+    }
+    Changed.notify_all();
+    Reader.join();
+    Stopping = false;
+  }
+  /** \brief stop the thread and drop everything read ahead */
+  void Drop()
+  {
+    Stop();
+    Head = Filled = 0;
+    Ended = Failed = false;
+  }
+  unsigned long long Unread() const
+  {
+    unsigned long long Size = 0;
+    for (size_t I = 0; I < Filled; ++I)
+    {
+      Chunk const &C = Ring[(Head + I) % Ring.size()];
+      Size += C.Size - C.Used;
+    }
+    return Size;
+  }
+  /** \brief runs an operation of the wrapped file at its own position */
+  template <typename Operation>
+  auto OnWrapped(Operation const &Op) -> decltype(Op())
+  {
+    Stop();
+    bool const OldDirect = Direct;
+    Direct = true;
+    auto const Res = Op();
+    Direct = OldDirect;
+    return Res;
+  }
+
+  public:
+  explicit ReadAheadFileFdPrivate(FileFdPrivate *Priv) : FileFdPrivate(Priv->filefd), wrapped(Priv), Head(0), Filled(0),
+                                                         Ended(false), Failed(false), Stopping(false), Direct(false),
+                                                         Consumed(0), FailedErrno(0), ReaderStalls(0), ConsumerStalls(0),
+                                                         ConsumerStallTime(0)
+  {
+  }
+
+  virtual APT::Configuration::Compressor get_compressor() const APT_OVERRIDE
+  {
+    return wrapped->get_compressor();
+  }
+  virtual void set_compressor(APT::Configuration::Compressor const &compressor) APT_OVERRIDE
+  {
+    return wrapped->set_compressor(compressor);
+  }
+  virtual unsigned int get_openmode() const APT_OVERRIDE
+  {
+    return wrapped->get_openmode();
+  }
+  virtual void set_openmode(unsigned int openmode) APT_OVERRIDE
+  {
+    return wrapped->set_openmode(openmode);
+  }
+  virtual bool get_is_pipe() const APT_OVERRIDE
+  {
+    return wrapped->get_is_pipe();
+  }
+  virtual void set_is_pipe(bool is_pipe) APT_OVERRIDE
+  {
+    FileFdPrivate::set_is_pipe(is_pipe);
+    wrapped->set_is_pipe(is_pipe);
+  }
+  virtual unsigned long long get_seekpos() const APT_OVERRIDE
+  {
+    return wrapped->get_seekpos();
+  }
+  virtual void set_seekpos(unsigned long long seekpos) APT_OVERRIDE
+  {
+    return wrapped->set_seekpos(seekpos);
+  }
+  virtual bool InternalOpen(int const iFd, unsigned int const Mode) APT_OVERRIDE
+  {
+    return wrapped->InternalOpen(iFd, Mode);
+  }
+  virtual ssize_t InternalUnbufferedRead(void *const To, unsigned long long const Size) APT_OVERRIDE
+  {
+    if (Direct)
+      return wrapped->InternalRead(To, Size);
+
+    std::unique_lock<std::mutex> Guard(Lock);
+    if (Filled == 0 && Ended == false && Failed == false)
+    {
+      if (Reader.joinable() == false)
+      {
+        if (Ring.empty())
+        {
+          Ring.resize(4);
+          for (auto &C : Ring)
+            C.Data.reset(new char[ChunkSize]);
+        }
+        try
+        {
+          Reader = std::thread(&ReadAheadFileFdPrivate::Read, this);
+        }
+        catch (std::system_error const &)
+        {
+          Direct = true;
+          Guard.unlock();
+          return wrapped->InternalRead(To, Size);
+        }
+      }
+      ++ConsumerStalls;
+      auto const Start = std::chrono::steady_clock::now();
+      Changed.wait(Guard, [&]
+                   { return Filled != 0 || Ended || Failed; });
+      ConsumerStallTime += std::chrono::steady_clock::now() - Start;
+    }
+    if (Filled == 0)
+    {
+      if (Ended)
+      {
+        Guard.unlock();
+        Stop();
+        return 0;
+      }
+      for (auto const &M : Messages)
+        _error->Insert(M.first, "%s", M.second.c_str());
+      Messages.clear();
+      errno = FailedErrno;
+      return -1;
+    }
+    Chunk &C = Ring[Head];
+    unsigned long long const Res = std::min(Size, C.Size - C.Used);
+    memcpy(To, C.Data.get() + C.Used, Res);
+    C.Used += Res;
+    Consumed += Res;
+    if (C.Used == C.Size)
+    {
+      Head = (Head + 1) % Ring.size();
+      --Filled;
+      Changed.notify_all();
+    }
+    return Res;
+  }
+  virtual bool InternalReadError() APT_OVERRIDE
+  {
+    return wrapped->InternalReadError();
+  }
+  virtual ssize_t InternalWrite(void const *const From, unsigned long long const Size) APT_OVERRIDE
+  {
+    return wrapped->InternalWrite(From, Size);
+  }
+  virtual bool InternalWriteError() APT_OVERRIDE
+  {
+    return wrapped->InternalWriteError();
+  }
+  virtual bool InternalSeek(unsigned long long const To) APT_OVERRIDE
+  {
+    if (Direct)
+      return wrapped->InternalSeek(To);
+    // a bit forward we can read on, otherwise the wrapped file has to seek
+    // from where the thread stopped reading
+    unsigned long long const Position = InternalTell();
+    if (Position <= To && To - Position <= Ring.size() * ChunkSize)
+      return FileFdPrivate::InternalSeek(To);
+    Stop();
+    wrapped->set_seekpos(Consumed + Unread());
+    Drop();
+    buffer.reset();
+    bool const Res = OnWrapped([&]
+                               { return wrapped->InternalSeek(To); });
+    Consumed = wrapped->InternalTell();
+    return Res;
+  }
+  virtual bool InternalTruncate(unsigned long long const Size) APT_OVERRIDE
+  {
+    return wrapped->InternalTruncate(Size);
+  }
+  virtual unsigned long long InternalTell() APT_OVERRIDE
+  {
+    if (Direct)
+      return wrapped->InternalTell() - buffer.size();
+    return Consumed - buffer.size();
+  }
+  virtual unsigned long long InternalSize() APT_OVERRIDE
+  {
+    if (Direct)
+      return wrapped->InternalSize();
+    // the wrapped file continues (and ends) where the thread stopped
+    // and it must not consume the lines buffered already
+    Stop();
+    set_seekpos(Consumed + Unread());
+    auto const Buffered = std::make_pair(buffer.bufferstart, buffer.bufferend);
+    buffer.reset();
+    auto const Size = OnWrapped([&]
+                                { return wrapped->InternalSize(); });
+    std::tie(buffer.bufferstart, buffer.bufferend) = Buffered;
+    return Size;
+  }
+  virtual bool InternalClose(std::string const &FileName) APT_OVERRIDE
+  {
+    if (Direct == false)
+    {
+      Drop();
+      if (Reader.joinable() == false && ConsumerStalls != 0 && _config->FindB("Debug::ReadAhead", false))
+        std::clog << "ReadAhead " << FileName << ": waited " << ConsumerStalls << " times for "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(ConsumerStallTime).count()
+                  << "ms, reader was ahead " << ReaderStalls << " times" << std::endl;
+      ConsumerStalls = ReaderStalls = 0;
+      ConsumerStallTime = std::chrono::steady_clock::duration::zero();
+    }
+    return wrapped->InternalClose(FileName);
+  }
+  virtual bool InternalStream() const APT_OVERRIDE
+  {
+    return wrapped->InternalStream();
+  }
+  virtual bool InternalAlwaysAutoClose() const APT_OVERRIDE
+  {
+    return wrapped->InternalAlwaysAutoClose();
+  }
+  virtual ~ReadAheadFileFdPrivate()
+  {
+    Drop();
+    delete wrapped;
+  }
+};
+/*}}}*/
 class APT_HIDDEN GzipFileFdPrivate : public FileFdPrivate
 { /*{{{*/
 #ifdef HAVE_ZLIB
@@ -1630,6 +2017,65 @@ class APT_HIDDEN Bz2FileFdPrivate : public FileFdPrivate
 #endif
 };
 /*}}}*/
+#if defined(HAVE_ZSTD) || defined(HAVE_LZMA)
+/* The inbuilt compressors understand the options of their binaries to set
+   threads and block size, so the same APT::Compressor::*::(Un)compressArg
+   configure both. A thread count of 0 stands for one per processor. */
+static uint32_t FindCompressorThreads(std::vector<std::string> const &Args, uint32_t const Default) /*{{{*/
+{
+  for (auto a = Args.rbegin(); a != Args.rend(); ++a)
+  {
+    char const *value;
+    if (APT::String::Startswith(*a, "--threads="))
+      value = a->c_str() + strlen("--threads=");
+    else if (APT::String::Startswith(*a, "-T") && a->length() > 2)
+      value = a->c_str() + 2;
+    else if (*a == "-T" && a != Args.rbegin())
+      value = (a - 1)->c_str();
+    else
+      continue;
+    char *end;
+    unsigned long const threads = strtoul(value, &end, 10);
+    if (end != value && *end == '\0')
+      return threads;
+  }
+  return Default;
+}
+/*}}}*/
+#endif
+#if defined(HAVE_ZSTD) || defined(HAVE_LZMA) || defined(HAVE_LZ4)
+static uint64_t FindCompressorBlockSize(std::vector<std::string> const &Args) /*{{{*/
+{
+  for (auto a = Args.rbegin(); a != Args.rend(); ++a)
+  {
+    if (APT::String::Startswith(*a, "--block-size=") == false)
+      continue;
+    char const *const value = a->c_str() + strlen("--block-size=");
+    char *end;
+    uint64_t size = strtoull(value, &end, 10);
+    if (end == value)
+      continue;
+    std::string const suffix = end;
+    if (suffix == "k" || suffix == "K" || suffix == "KB" || suffix == "KiB")
+      size *= 1024;
+    else if (suffix == "M" || suffix == "MB" || suffix == "MiB")
+      size *= 1024 * 1024;
+    else if (suffix == "G" || suffix == "GB" || suffix == "GiB")
+      size *= 1024 * 1024 * 1024;
+    else if (suffix.empty() == false)
+      continue;
+    return size;
+  }
+  return 0;
+}
+/*}}}*/
+#endif
+/* Files are written as one frame, unless a --block-size is given in the
+   compress arguments: the file is then a series of frames of that size
+   which carry their size in their header. Decoders older than this one stop
+   after the first frame, so this has to be asked for. To seek in such a file
+   we can skip from frame to frame reading only their block headers and
+   decode just the frame containing the new position. */
 class APT_HIDDEN Lz4FileFdPrivate : public FileFdPrivate
 { /*{{{*/
   static constexpr unsigned long long LZ4_HEADER_SIZE = 19;
@@ -1642,6 +2088,91 @@ class APT_HIDDEN Lz4FileFdPrivate : public FileFdPrivate
   simple_buffer lz4_buffer;
   // Count of bytes that the decompressor expects to read next, or buffer size.
   size_t next_to_load = APT_BUFFER_SIZE;
+  // the content of the frame to write next, if written in frames
+  simple_buffer frame;
+  unsigned long long frame_size = 0;
+  bool frame_written = false;
+  // where each frame starts in the file and in the content
+  std::vector<std::pair<unsigned long long, unsigned long long>> frames;
+  bool frames_read = false;
+
+  static uint32_t le32(unsigned char const *const b)
+  {
+    return b[0] | (b[1] << 8) | (b[2] << 16) | (static_cast<uint32_t>(b[3]) << 24);
+  }
+  bool WriteFrame()
+  {
+    LZ4F_preferences_t prefs;
+    memset(&prefs, 0, sizeof(prefs));
+    prefs.frameInfo.contentSize = frame.size();
+    res = LZ4F_compressBegin(cctx, lz4_buffer.buffer, lz4_buffer.buffersize_max, &prefs);
+    if (LZ4F_isError(res))
+      return false;
+    size_t length = res;
+    res = LZ4F_compressUpdate(cctx, lz4_buffer.buffer + length, lz4_buffer.buffersize_max - length,
+                              frame.get(), frame.size(), nullptr);
+    if (LZ4F_isError(res))
+      return false;
+    length += res;
+    res = LZ4F_compressEnd(cctx, lz4_buffer.buffer + length, lz4_buffer.buffersize_max - length, nullptr);
+    if (LZ4F_isError(res))
+      return false;
+    length += res;
+    frame.reset();
+    frame_written = true;
+    return backend.Write(lz4_buffer.buffer, length);
+  }
+  /** \brief find the frames of the file, if all of them have a known size */
+  bool ReadFrames()
+  {
+    frames_read = true;
+    int const fd = backend.Fd();
+    struct stat Buf;
+    if (fstat(fd, &Buf) != 0 || S_ISREG(Buf.st_mode) == false)
+      return false;
+    std::vector<std::pair<unsigned long long, unsigned long long>> found;
+    unsigned long long offset = 0;
+    unsigned long long content = 0;
+    while (offset < static_cast<unsigned long long>(Buf.st_size))
+    {
+      unsigned char header[LZ4_HEADER_SIZE];
+      ssize_t const n = pread(fd, header, sizeof(header), offset);
+      if (n < 8)
+        return false;
+      uint32_t const magic = le32(header);
+      if ((magic & 0xFFFFFFF0) == 0x184D2A50)
+      {
+        // skippable frames contribute nothing to the content
+        offset += 8 + le32(header + 4);
+        continue;
+      }
+      unsigned char const flags = header[4];
+      // content size, optional dictionary id and header checksum
+      size_t const header_size = 7 + 8 + ((flags & 0x01) != 0 ? 4 : 0);
+      if (magic != 0x184D2204 || (flags & 0x08) == 0 || static_cast<size_t>(n) < header_size)
+        return false;
+      found.emplace_back(offset, content);
+      content += le32(header + 6) | (static_cast<uint64_t>(le32(header + 10)) << 32);
+      offset += header_size;
+      while (true)
+      {
+        unsigned char block[4];
+        if (pread(fd, block, sizeof(block), offset) != sizeof(block))
+          return false;
+        offset += sizeof(block);
+        uint32_t const block_size = le32(block);
+        if (block_size == 0)
+          break;
+        offset += (block_size & 0x7FFFFFFF) + ((flags & 0x10) != 0 ? 4 : 0);
+      }
+      if ((flags & 0x04) != 0)
+        offset += 4;
+    }
+    if (found.size() < 2)
+      return false;
+    frames = std::move(found);
+    return true;
+  }
 
   public:
   virtual bool InternalOpen(int const iFd, unsigned int const Mode) APT_OVERRIDE
@@ -1652,7 +2183,17 @@ class APT_HIDDEN Lz4FileFdPrivate : public FileFdPrivate
     if ((Mode & FileFd::WriteOnly) == FileFd::WriteOnly)
     {
       res = LZ4F_createCompressionContext(&cctx, LZ4F_VERSION);
-      lz4_buffer.reset(LZ4F_compressBound(APT_BUFFER_SIZE, nullptr) + LZ4_HEADER_SIZE + LZ4_FOOTER_SIZE);
+      frame_size = std::min<uint64_t>(FindCompressorBlockSize(compressor.CompressArgs), std::numeric_limits<uint32_t>::max());
+      if (frame_size != 0)
+      {
+        LZ4F_preferences_t prefs;
+        memset(&prefs, 0, sizeof(prefs));
+        prefs.frameInfo.contentSize = frame_size;
+        lz4_buffer.reset(LZ4F_compressFrameBound(frame_size, &prefs));
+        frame.reset(frame_size);
+      }
+      else
+        lz4_buffer.reset(LZ4F_compressBound(APT_BUFFER_SIZE, nullptr) + LZ4_HEADER_SIZE + LZ4_FOOTER_SIZE);
     }
     else
     {
@@ -1669,8 +2210,8 @@ class APT_HIDDEN Lz4FileFdPrivate : public FileFdPrivate
     if (backend.OpenDescriptor(iFd, flags, FileFd::None, true) == false)
       return false;
 
-    // Write the file header
-    if ((Mode & FileFd::WriteOnly) == FileFd::WriteOnly)
+    // Write the file header, frames write their own
+    if ((Mode & FileFd::WriteOnly) == FileFd::WriteOnly && frame_size == 0)
     {
       res = LZ4F_compressBegin(cctx, lz4_buffer.buffer, lz4_buffer.buffersize_max, nullptr);
       if (LZ4F_isError(res) || backend.Write(lz4_buffer.buffer, res) == false)
@@ -1681,22 +2222,25 @@ class APT_HIDDEN Lz4FileFdPrivate : public FileFdPrivate
   }
   virtual ssize_t InternalUnbufferedRead(void *const To, unsigned long long const Size) APT_OVERRIDE
   {
-    /* Keep reading as long as the compressor still wants to read */
-    while (next_to_load)
+    /* Keep reading as long as the compressor still wants to read,
+       or until the end of the file if a frame was completed */
+    while (true)
     {
       // Fill compressed buffer;
       if (lz4_buffer.empty())
       {
         unsigned long long read;
         /* Reset - if LZ4 decompressor wants to read more, allocate more */
-        lz4_buffer.reset(next_to_load);
+        lz4_buffer.reset(std::max<size_t>(next_to_load, APT_BUFFER_SIZE));
         if (backend.Read(lz4_buffer.getend(), lz4_buffer.free(), &read) == false)
           return -1;
         lz4_buffer.bufferend += read;
 
-        /* Expected EOF */
         if (read == 0)
         {
+          /* Expected EOF */
+          if (next_to_load == 0)
+            return 0;
           res = -1;
           return filefd->FileFdError("LZ4F: %s %s",
                                      filefd->FileName.c_str(),
@@ -1718,8 +2262,6 @@ class APT_HIDDEN Lz4FileFdPrivate : public FileFdPrivate
       if (out != 0)
         return out;
     }
-
-    return 0;
   }
   virtual bool InternalReadError() APT_OVERRIDE
   {
@@ -1729,6 +2271,14 @@ class APT_HIDDEN Lz4FileFdPrivate : public FileFdPrivate
   }
   virtual ssize_t InternalWrite(void const *const From, unsigned long long const Size) APT_OVERRIDE
   {
+    if (frame_size != 0)
+    {
+      ssize_t const towrite = frame.write(From, Size);
+      if (frame.full() && WriteFrame() == false)
+        return -1;
+      return towrite;
+    }
+
     unsigned long long const towrite = std::min(APT_BUFFER_SIZE, Size);
 
     res = LZ4F_compressUpdate(cctx,
@@ -1746,6 +2296,36 @@ class APT_HIDDEN Lz4FileFdPrivate : public FileFdPrivate
 
     return filefd->FileFdError("LZ4F: %s %s (%zu: %s)", filefd->FileName.c_str(), _("Write error"), res, errmsg);
   }
+  virtual bool InternalSeek(unsigned long long const To) APT_OVERRIDE
+  {
+    if (cctx == nullptr && (frames_read == true || ReadFrames() == true) && frames.empty() == false)
+    {
+      auto const FrameOf = [&](unsigned long long const Pos)
+      {
+        return std::upper_bound(frames.begin(), frames.end(), Pos, [](unsigned long long const P, std::pair<unsigned long long, unsigned long long> const &F)
+                                { return P < F.second; }) -
+               1;
+      };
+      unsigned long long const Current = filefd->Tell();
+      auto const Target = FrameOf(To);
+      if (To < Current || Target != FrameOf(Current))
+      {
+        LZ4F_freeDecompressionContext(dctx);
+        dctx = nullptr;
+        res = LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION);
+        if (LZ4F_isError(res) || backend.Seek(Target->first) == false)
+          return filefd->FileFdError("Unable to seek to %llu", To);
+        lz4_buffer.reset();
+        next_to_load = APT_BUFFER_SIZE;
+        buffer.reset();
+        seekpos = Target->second;
+        if (To == seekpos)
+          return true;
+        return filefd->Skip(To - seekpos);
+      }
+    }
+    return FileFdPrivate::InternalSeek(To);
+  }
   virtual bool InternalStream() const APT_OVERRIDE { return true; }
 
   virtual bool InternalFlush() APT_OVERRIDE
@@ -1763,8 +2343,14 @@ class APT_HIDDEN Lz4FileFdPrivate : public FileFdPrivate
     {
       if (filefd->Failed() == false)
       {
-        res = LZ4F_compressEnd(cctx, lz4_buffer.buffer, lz4_buffer.buffersize_max, nullptr);
-        if (LZ4F_isError(res) || backend.Write(lz4_buffer.buffer, res) == false)
+        if (frame_size == 0)
+        {
+          res = LZ4F_compressEnd(cctx, lz4_buffer.buffer, lz4_buffer.buffersize_max, nullptr);
+          if (LZ4F_isError(res) || backend.Write(lz4_buffer.buffer, res) == false)
+            return false;
+        }
+        // an empty file still needs a frame to be a valid lz4 file
+        else if ((frame.empty() == false || frame_written == false) && WriteFrame() == false)
           return false;
         if (!backend.Flush())
           return false;
@@ -1820,6 +2406,17 @@ class APT_HIDDEN ZstdFileFdPrivate : public FileFdPrivate /*{{{*/
       cctx = ZSTD_createCStream();
       res = ZSTD_initCStream(cctx, findLevel(compressor.CompressArgs));
       zstd_buffer.reset(APT_BUFFER_SIZE);
+      long threads = FindCompressorThreads(compressor.CompressArgs, 1);
+      if (threads == 0)
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+      // a library built without threading support compresses on its own
+      if (ZSTD_isError(res) == false && threads > 1 &&
+          ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, std::min(threads, 200l))) == false)
+      {
+        uint64_t const jobsize = FindCompressorBlockSize(compressor.CompressArgs);
+        if (jobsize != 0)
+          res = ZSTD_CCtx_setParameter(cctx, ZSTD_c_jobSize, std::min(jobsize, UINT64_C(1) << 30));
+      }
     }
     else
     {
@@ -1917,11 +2514,17 @@ class APT_HIDDEN ZstdFileFdPrivate : public FileFdPrivate /*{{{*/
        .pos = 0,
     };
 
-    res = ZSTD_compressStream(cctx, &out, &in);
-
-    if (ZSTD_isError(res) || backend.Write(zstd_buffer.buffer, out.pos) == false)
-      return -1;
-
+    // with workers the input can have to wait until a job is flushed,
+    // so keep draining until some of it is taken
+    do
+    {
+      out.pos = 0;
+      res = ZSTD_compressStream(cctx, &out, &in);
+      if (ZSTD_isError(res) == false && in.pos == 0 && out.pos == 0)
+        res = ZSTD_flushStream(cctx, &out);
+      if (ZSTD_isError(res) || backend.Write(zstd_buffer.buffer, out.pos) == false)
+        return -1;
+    } while (in.pos == 0 && Size != 0);
     return in.pos;
   }
 
@@ -2021,8 +2624,25 @@ class APT_HIDDEN LzmaFileFdPrivate : public FileFdPrivate
     lzma_ret err;
     bool eof;
     bool compressing;
+#if LZMA_VERSION >= UINT32_C(50040002)
+    // the index of a multi-block file to seek in by decoding only one block
+    lzma_index *index;
+    bool indexed;
+    // the stream decodes only this block instead of the whole file
+    lzma_index_iter block;
+    bool blockwise;
+    // the single-threaded encoder ends a block after this much input
+    uint64_t blocksize;
+    uint64_t blockfill;
+#endif
 
+#if LZMA_VERSION >= UINT32_C(50040002)
+    explicit LZMAFILE(FileFd *const fd) : file(nullptr), filefd(fd), eof(false), compressing(false),
+                                          index(nullptr), indexed(false), blockwise(false),
+                                          blocksize(0), blockfill(0) { buffer[0] = '\0'; }
+#else
     explicit LZMAFILE(FileFd *const fd) : file(nullptr), filefd(fd), eof(false), compressing(false) { buffer[0] = '\0'; }
+#endif
     ~LZMAFILE()
     {
       if (compressing == true && filefd->Failed() == false)
@@ -2049,14 +2669,105 @@ class APT_HIDDEN LzmaFileFdPrivate : public FileFdPrivate
         }
       }
       lzma_end(&stream);
+#if LZMA_VERSION >= UINT32_C(50040002)
+      lzma_index_end(index, nullptr);
+#endif
       fclose(file);
     }
   };
   LZMAFILE *lzma;
+#if LZMA_VERSION >= UINT32_C(50040002)
+  /** \brief read the index at the end of the file(s) which lists all blocks */
+  bool ReadIndex()
+  {
+    lzma->indexed = true;
+    struct stat Buf;
+    if (fstat(fileno(lzma->file), &Buf) != 0 || S_ISREG(Buf.st_mode) == false)
+      return false;
+    uint64_t constexpr memlimit = 1024 * 1024 * 500;
+    lzma_stream info = LZMA_STREAM_INIT;
+    if (lzma_file_info_decoder(&info, &lzma->index, memlimit, Buf.st_size) != LZMA_OK)
+      return false;
+    uint8_t buffer[4096];
+    off_t offset = 0;
+    lzma_ret err;
+    do
+    {
+      if (info.avail_in == 0)
+      {
+        ssize_t const n = pread(fileno(lzma->file), buffer, sizeof(buffer), offset);
+        if (n < 0)
+          break;
+        offset += n;
+        info.next_in = buffer;
+        info.avail_in = n;
+      }
+      err = lzma_code(&info, info.avail_in == 0 ? LZMA_FINISH : LZMA_RUN);
+      if (err == LZMA_SEEK_NEEDED)
+      {
+        offset = info.seek_pos;
+        info.avail_in = 0;
+        err = LZMA_OK;
+      }
+    } while (err == LZMA_OK);
+    lzma_end(&info);
+    if (err != LZMA_STREAM_END)
+    {
+      lzma_index_end(lzma->index, nullptr);
+      lzma->index = nullptr;
+      return false;
+    }
+    return true;
+  }
+  /** \brief continue decoding with the (first) block of lzma->block */
+  bool StartBlock()
+  {
+    uint8_t header[LZMA_BLOCK_HEADER_SIZE_MAX];
+    if (fseeko(lzma->file, lzma->block.block.compressed_file_offset, SEEK_SET) != 0 ||
+        fread(header, 1, 1, lzma->file) != 1)
+      return false;
+    lzma_filter filters[LZMA_FILTERS_MAX + 1];
+    lzma_block block = {};
+    block.version = 1;
+    block.check = lzma->block.stream.flags->check;
+    block.filters = filters;
+    block.header_size = lzma_block_header_size_decode(header[0]);
+    if (fread(header + 1, 1, block.header_size - 1, lzma->file) != block.header_size - 1 ||
+        lzma_block_header_decode(&block, nullptr, header) != LZMA_OK)
+      return false;
+    lzma_ret err = lzma_block_compressed_size(&block, lzma->block.block.unpadded_size);
+    if (err == LZMA_OK)
+      err = lzma_block_decoder(&lzma->stream, &block);
+    lzma_filters_free(filters, nullptr);
+    lzma->stream.avail_in = 0;
+    lzma->eof = false;
+    lzma->blockwise = true;
+    return err == LZMA_OK;
+  }
+  /** \brief write out the current block, so that a new one is started */
+  bool EndBlock()
+  {
+    lzma->blockfill = 0;
+    size_t constexpr buffersize = sizeof(lzma->buffer) / sizeof(lzma->buffer[0]);
+    do
+    {
+      lzma->stream.next_out = lzma->buffer;
+      lzma->stream.avail_out = buffersize;
+      lzma->err = lzma_code(&lzma->stream, LZMA_FULL_BARRIER);
+      if (lzma->err != LZMA_OK && lzma->err != LZMA_STREAM_END)
+        return false;
+      size_t const n = buffersize - lzma->stream.avail_out;
+      if (n != 0 && fwrite(lzma->buffer, 1, n, lzma->file) != n)
+        return false;
+    } while (lzma->err != LZMA_STREAM_END);
+    lzma->err = LZMA_OK;
+    return true;
+  }
+#endif
   static uint32_t findXZlevel(std::vector<std::string> const &Args)
   {
     for (auto a = Args.rbegin(); a != Args.rend(); ++a)
-      if (a->empty() == false && (*a)[0] == '-' && (*a)[1] != '-')
+      if (a->empty() == false && (*a)[0] == '-' && (*a)[1] != '-' && (*a)[1] != 'T')
       {
         auto const number = a->find_last_of("0123456789");
         if (number == std::string::npos)
@@ -2112,10 +2823,37 @@ class APT_HIDDEN LzmaFileFdPrivate : public FileFdPrivate
     if ((Mode & FileFd::WriteOnly) == FileFd::WriteOnly)
     {
       uint32_t const xzlevel = findXZlevel(compressor.CompressArgs);
+#if LZMA_VERSION >= UINT32_C(50040002)
+      uint32_t threads = FindCompressorThreads(compressor.CompressArgs, 1);
+      if (threads == 0)
+        threads = lzma_cputhreads();
+      uint64_t const blocksize = FindCompressorBlockSize(compressor.CompressArgs);
+#endif
       if (compressor.Name == "xz")
       {
-        if (lzma_easy_encoder(&lzma->stream, xzlevel, LZMA_CHECK_CRC64) != LZMA_OK)
-          return false;
+#if LZMA_VERSION >= UINT32_C(50040002)
+        // independent blocks, which can be decoded in parallel by new
+        // decoders and one after the other by old ones. With one thread
+        // the blocks are ended by InternalWrite as xz does it.
+        if (threads > 1)
+        {
+          lzma_mt mt = {};
+          mt.threads = std::min(std::max(threads, UINT32_C(1)), UINT32_C(16384));
+          mt.block_size = blocksize;
+          mt.preset = xzlevel;
+          mt.check = LZMA_CHECK_CRC64;
+          if (lzma_stream_encoder_mt(&lzma->stream, &mt) != LZMA_OK)
+            return false;
+        }
+        else
+        {
+          lzma->blocksize = blocksize;
+#endif
+          if (lzma_easy_encoder(&lzma->stream, xzlevel, LZMA_CHECK_CRC64) != LZMA_OK)
+            return false;
+#if LZMA_VERSION >= UINT32_C(50040002)
+        }
+#endif
       }
       else
       {
@@ -2129,6 +2867,24 @@ class APT_HIDDEN LzmaFileFdPrivate : public FileFdPrivate
     else
     {
       uint64_t constexpr memlimit = 1024 * 1024 * 500;
+#if LZMA_VERSION >= UINT32_C(50040002)
+      // if requested, blocks with known sizes are decoded in parallel and
+      // everything else by the calling thread as with the single-threaded
+      // decoder. It isn't the default as FileFd is also used in the methods.
+      uint32_t threads = FindCompressorThreads(compressor.UncompressArgs, 1);
+      if (threads == 0)
+        threads = lzma_cputhreads();
+      if (compressor.Name == "xz" && threads > 1)
+      {
+        lzma_mt mt = {};
+        mt.threads = std::min(threads, UINT32_C(16384));
+        mt.memlimit_threading = std::min(memlimit, lzma_physmem() / 4);
+        mt.memlimit_stop = memlimit;
+        if (lzma_stream_decoder_mt(&lzma->stream, &mt) != LZMA_OK)
+          return false;
+      }
+      else
+#endif
       if (lzma_auto_decoder(&lzma->stream, memlimit, 0) != LZMA_OK)
         return false;
       lzma->compressing = false;
@@ -2149,6 +2905,25 @@ class APT_HIDDEN LzmaFileFdPrivate : public FileFdPrivate
       lzma->stream.avail_in = fread(lzma->buffer, 1, sizeof(lzma->buffer) / sizeof(lzma->buffer[0]), lzma->file);
     }
     lzma->err = lzma_code(&lzma->stream, LZMA_RUN);
+#if LZMA_VERSION >= UINT32_C(50040002)
+    if (lzma->err == LZMA_STREAM_END && lzma->blockwise == true &&
+        lzma_index_iter_next(&lzma->block, LZMA_INDEX_ITER_NONEMPTY_BLOCK) == false)
+    {
+      if (StartBlock() == false)
+      {
+        lzma->err = LZMA_DATA_ERROR;
+        errno = 0;
+        return -1;
+      }
+      Res = Size - lzma->stream.avail_out;
+      if (Res == 0)
+      {
+        Res = -1;
+        errno = EINTR;
+      }
+      return Res;
+    }
+#endif
     if (lzma->err == LZMA_STREAM_END)
     {
       lzma->eof = true;
@@ -2178,8 +2953,13 @@ class APT_HIDDEN LzmaFileFdPrivate : public FileFdPrivate
   virtual ssize_t InternalWrite(void const *const From, unsigned long long const Size) APT_OVERRIDE
   {
     ssize_t Res;
+    unsigned long long ToWrite = Size;
+#if LZMA_VERSION >= UINT32_C(50040002)
+    if (lzma->blocksize != 0)
+      ToWrite = std::min<unsigned long long>(ToWrite, lzma->blocksize - lzma->blockfill);
+#endif
     lzma->stream.next_in = (uint8_t *)From;
-    lzma->stream.avail_in = Size;
+    lzma->stream.avail_in = ToWrite;
     lzma->stream.next_out = lzma->buffer;
     lzma->stream.avail_out = sizeof(lzma->buffer) / sizeof(lzma->buffer[0]);
     lzma->err = lzma_code(&lzma->stream, LZMA_RUN);
@@ -2194,7 +2974,14 @@ class APT_HIDDEN LzmaFileFdPrivate : public FileFdPrivate
     }
     else
     {
-      Res = Size - lzma->stream.avail_in;
+      Res = ToWrite - lzma->stream.avail_in;
+#if LZMA_VERSION >= UINT32_C(50040002)
+      if (lzma->blocksize != 0 && (lzma->blockfill += Res) == lzma->blocksize && EndBlock() == false)
+      {
+        errno = 0;
+        return -1;
+      }
+#endif
       if (Res == 0)
       {
         // lzma run was okay, but produced no output…
@@ -2208,6 +2995,35 @@ class APT_HIDDEN LzmaFileFdPrivate : public FileFdPrivate
   {
     return filefd->FileFdError("lzma_write: %s (%d)", _("Write error"), lzma->err);
   }
+#if LZMA_VERSION >= UINT32_C(50040002)
+  virtual bool InternalSeek(unsigned long long const To) APT_OVERRIDE
+  {
+    // files with many blocks, like those written with --block-size, are
+    // decoded from the block containing the new position on
+    if (lzma->compressing == false && compressor.Name == "xz" &&
+        (lzma->indexed == true || ReadIndex() == true) &&
+        lzma->index != nullptr && lzma_index_block_count(lzma->index) > 1)
+    {
+      unsigned long long const Current = filefd->Tell();
+      lzma_index_iter target;
+      lzma_index_iter_init(&target, lzma->index);
+      if (lzma_index_iter_locate(&target, To) == false &&
+          (lzma->blockwise == false || To < Current ||
+           target.block.number_in_file != lzma->block.block.number_in_file))
+      {
+        lzma->block = target;
+        buffer.reset();
+        if (StartBlock() == false)
+          return filefd->FileFdError("Unable to seek to %llu", To);
+        seekpos = target.block.uncompressed_file_offset;
+        if (To == seekpos)
+          return true;
+        return filefd->Skip(To - seekpos);
+      }
+    }
+    return FileFdPrivate::InternalSeek(To);
+  }
+#endif
   virtual bool InternalStream() const APT_OVERRIDE { return true; }
   virtual bool InternalClose(std::string const &) APT_OVERRIDE
   {
@@ -2337,6 +3153,10 @@ class APT_HIDDEN PipedFileFdPrivate : public FileFdPrivate /*{{{*/
   {
     return write(filefd->iFd, From, Size);
   }
+  virtual ssize_t InternalWriteV(struct iovec const *const Vec, int const Count) APT_OVERRIDE
+  {
+    return writev(filefd->iFd, Vec, Count);
+  }
   virtual bool InternalClose(std::string const &) APT_OVERRIDE
   {
     bool Ret = true;
@@ -2372,6 +3192,15 @@ class APT_HIDDEN DirectFileFdPrivate : public FileFdPrivate /*{{{*/
     }
     return write(filefd->iFd, From, Size);
   }
+  virtual ssize_t InternalWriteV(struct iovec const *const Vec, int const Count) APT_OVERRIDE
+  {
+    if (buffer.size() != 0)
+    {
+      lseek(filefd->iFd, -buffer.size(), SEEK_CUR);
+      buffer.reset();
+    }
+    return writev(filefd->iFd, Vec, Count);
+  }
   virtual bool InternalSeek(unsigned long long const To) APT_OVERRIDE
   {
     off_t const res = lseek(filefd->iFd, To, SEEK_SET);
@@ -2727,6 +3556,11 @@ bool FileFd::OpenInternDescriptor(unsigned int const Mode, APT::Configuration::C
     APT_COMPRESS_INIT("zstd", ZstdFileFdPrivate);
 #endif
 #undef APT_COMPRESS_INIT
+    if (d != nullptr)
+    {
+      if ((Mode & (ReadAhead | WriteOnly)) == ReadAhead)
+        d = new ReadAheadFileFdPrivate(d);
+    }
     else if (compressor.Name == "." || compressor.Binary.empty() == true)
        d = new DirectFileFdPrivate(this);
     else d = new PipedFileFdPrivate(this);
@@ -2909,6 +3743,43 @@ bool FileFd::Write(const void *From, unsigned long long Size)
 
   return FileFdError(_("write, still have %llu to write but couldn't"), Size);
 }
+bool FileFd::Write(struct iovec *Vec, size_t Count)
+{
+  if (d == nullptr || Failed())
+    return false;
+  while (true)
+  {
+    for (; Count != 0 && Vec->iov_len == 0; ++Vec, --Count)
+      ;
+    if (Count == 0)
+      return true;
+
+    errno = 0;
+    ssize_t Res = d->InternalWriteV(Vec, std::min<size_t>(Count, IOV_MAX));
+    if (Res < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return d->InternalWriteError();
+    }
+    if (Res == 0)
+      break;
+    d->set_seekpos(d->get_seekpos() + Res);
+
+    // skip what was written
+    for (; Count != 0 && static_cast<size_t>(Res) >= Vec->iov_len; ++Vec, --Count)
+      Res -= Vec->iov_len;
+    if (Count == 0)
+      return true;
+    Vec->iov_base = static_cast<char *>(Vec->iov_base) + Res;
+    Vec->iov_len -= Res;
+  }
+
+  unsigned long long Size = 0;
+  for (size_t I = 0; I < Count; ++I)
+    Size += Vec[I].iov_len;
+  return FileFdError(_("write, still have %llu to write but couldn't"), Size);
+}
 bool FileFd::Write(int Fd, const void *From, unsigned long long Size)
 {
   while (Size > 0)
@@ -37,6 +37,7 @@
 #define APT_HAS_GZIP 1
 
 class FileFdPrivate;
+struct iovec;
 class APT_PUBLIC FileFd
 {
   friend class FileFdPrivate;
@@ -76,6 +77,8 @@ class APT_PUBLIC FileFd
     Atomic = Exclusive | (1 << 4),
     Empty = (1 << 5),
     BufferedWrite = (1 << 6),
+    /** decompress ahead in a thread while the data read so far is processed */
+    ReadAhead = (1 << 7),
 
     WriteEmpty = ReadWrite | Create | Empty,
     WriteExists = ReadWrite,
@@ -130,6 +133,15 @@ class APT_PUBLIC FileFd
   bool ReadLine(std::string &To);
   bool Flush();
   bool Write(const void *From, unsigned long long Size);
+  /** \brief writes the given pieces in order, with a single system call if possible
+   *
+   * Plain files and pipes get all pieces with one writev(2), buffered files
+   * copy them into their buffer and compressed files take them one by one.
+   *
+   * @param Vec pieces to write, which are changed while writing them
+   * @param Count number of pieces
+   */
+  bool Write(struct iovec *Vec, size_t Count);
   bool static Write(int Fd, const void *From, unsigned long long Size);
   bool Seek(unsigned long long To);
   bool Skip(unsigned long long To);
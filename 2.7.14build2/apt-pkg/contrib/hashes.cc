@@ -21,11 +21,16 @@
 #include <apt-pkg/tagfile.h>
 
 #include <algorithm>
+#include <array>
 #include <cassert>
+#include <condition_variable>
 #include <cstddef>
 #include <cstdlib>
 #include <iostream>
+#include <mutex>
 #include <string>
+#include <system_error>
+#include <thread>
 #include <unistd.h>
 
 #include <gcrypt.h>
@@ -307,12 +312,41 @@ bool HashStringList::operator!=(HashStringList const &other) const
 /*}}}*/
 
 // PrivateHashes							/*{{{*/
+/* With more than one algorithm requested and APT::Hashes-Threads allowing
+   it, each (or each group if we are limited to fewer threads) gets a handle
+   of its own. Small inputs are hashed by the caller one handle after the
+   other, but once the input exceeds a chunk, threads are started: Add
+   copies the data into a ring of chunks shared read-only by all threads and
+   returns while they are still hashing, so AddFD reads the next chunk in
+   the meantime. If the threads can't be started, the caller hashes it all. */
 class PrivateHashes
 {
   public:
   unsigned long long FileSize;
   gcry_md_hd_t hd;
 
+  struct Worker
+  {
+    gcry_md_hd_t hd;
+    std::thread Thread;
+    // chunks this thread is done with
+    unsigned long long Done;
+  };
+  std::vector<Worker> Workers;
+
+  static constexpr size_t ChunkSize = 2 * APT_BUFFER_SIZE;
+  std::array<std::vector<unsigned char>, 8> Ring;
+  // the chunk being filled, not yet visible to the threads
+  std::vector<unsigned char> *Current = nullptr;
+  // chunks handed to the threads
+  unsigned long long Filled = 0;
+  bool Stopping = false;
+  // threads couldn't be started, so the caller hashes everything
+  bool Serial = false;
+  std::mutex Lock;
+  std::condition_variable Wake;
+  std::condition_variable Room;
+
   void maybeInit()
   {
 
@@ -323,6 +357,12 @@ class PrivateHashes
     // only leaves us with this option...
     if (!gcry_control(GCRYCTL_INITIALIZATION_FINISHED_P))
     {
+      // libgcrypt picks the SHA extensions, AVX2, … the processor has at
+      // runtime, but it can be told not to – e.g. to compare the speed
+      for (auto const &hwf : _config->FindVector("APT::Hashes-DisableHWF"))
+        if (gcry_control(GCRYCTL_DISABLE_HWF, hwf.c_str(), nullptr) != 0)
+          fprintf(stderr, "libgcrypt has no hardware feature %s to disable\n", hwf.c_str());
+
       if (!gcry_check_version(nullptr))
       {
         fprintf(stderr, "libgcrypt is too old (need %s, have %s)\n",
@@ -334,29 +374,166 @@ class PrivateHashes
     }
   }
 
+  void Enable(std::vector<int> const &Algos)
+  {
+    gcry_md_open(&hd, 0, 0);
+    // threads are opt-in as Hashes is used everywhere, including the methods
+    auto const Configured = std::max(0, _config->FindI("APT::Hashes-Threads", 1));
+    unsigned long const Threads = std::min<unsigned long>(Algos.size(), Configured);
+    if (Threads < 2)
+    {
+      for (auto const algo : Algos)
+        gcry_md_enable(hd, algo);
+      return;
+    }
+    Workers.resize(Threads);
+    for (auto &w : Workers)
+    {
+      gcry_md_open(&w.hd, 0, 0);
+      w.Done = 0;
+    }
+    for (size_t i = 0; i < Algos.size(); ++i)
+      gcry_md_enable(Workers[i % Threads].hd, Algos[i]);
+  }
+
+  /** \brief handle calculating the given algorithm */
+  gcry_md_hd_t Handle(int const algo)
+  {
+    for (auto const &w : Workers)
+      if (gcry_md_is_enabled(w.hd, algo))
+        return w.hd;
+    return hd;
+  }
+
+  void Hash(Worker &w)
+  {
+    std::unique_lock<std::mutex> lock(Lock);
+    while (true)
+    {
+      Wake.wait(lock, [&]
+                { return w.Done != Filled || Stopping; });
+      if (w.Done == Filled)
+        return;
+      auto const &chunk = Ring[w.Done % Ring.size()];
+      lock.unlock();
+      gcry_md_write(w.hd, chunk.data(), chunk.size());
+      lock.lock();
+      ++w.Done;
+      Room.notify_one();
+    }
+  }
+
+  /** \brief start a thread per handle, or none at all if that fails */
+  bool Start()
+  {
+    try
+    {
+      for (auto &w : Workers)
+        w.Thread = std::thread(&PrivateHashes::Hash, this, std::ref(w));
+      return true;
+    }
+    catch (std::system_error const &)
+    {
+      // the threads already started have nothing to hash yet
+      Finish();
+      return false;
+    }
+  }
+
+  void Add(unsigned char const *Data, unsigned long long Size)
+  {
+    if (Workers.empty())
+    {
+      gcry_md_write(hd, Data, Size);
+      return;
+    }
+    if (Workers.front().Thread.joinable() == false)
+    {
+      // small inputs aren't worth the threads, and if they can't be
+      // started the calling thread has to do all the work
+      if (Serial || FileSize + Size <= ChunkSize || (Serial = not Start()))
+      {
+        for (auto &w : Workers)
+          gcry_md_write(w.hd, Data, Size);
+        return;
+      }
+    }
+    while (Size != 0)
+    {
+      if (Current == nullptr)
+      {
+        std::unique_lock<std::mutex> lock(Lock);
+        Room.wait(lock, [&]
+                  { return std::all_of(Workers.begin(), Workers.end(), [&](Worker const &w)
+                                       { return w.Done + Ring.size() > Filled; }); });
+        Current = &Ring[Filled % Ring.size()];
+        Current->reserve(ChunkSize);
+        Current->clear();
+      }
+      auto const n = std::min<unsigned long long>(Size, ChunkSize - Current->size());
+      Current->insert(Current->end(), Data, Data + n);
+      Data += n;
+      Size -= n;
+      if (Current->size() == ChunkSize)
+        Publish();
+    }
+  }
+
+  void Publish()
+  {
+    std::lock_guard<std::mutex> lock(Lock);
+    Current = nullptr;
+    ++Filled;
+    Wake.notify_all();
+  }
+
+  /** \brief let the threads hash all data and end */
+  void Finish()
+  {
+    if (std::none_of(Workers.begin(), Workers.end(), [](Worker const &w)
+                     { return w.Thread.joinable(); }))
+      return;
+    if (Current != nullptr)
+      Publish();
+    {
+      std::lock_guard<std::mutex> lock(Lock);
+      Stopping = true;
+      Wake.notify_all();
+    }
+    for (auto &w : Workers)
+      if (w.Thread.joinable())
+        w.Thread.join();
+    Stopping = false;
+  }
+
   explicit PrivateHashes(unsigned int const CalcHashes) : FileSize(0)
   {
     maybeInit();
-    gcry_md_open(&hd, 0, 0);
+    std::vector<int> Algos;
     for (auto &Algo : Algorithms)
     {
       if ((CalcHashes & Algo.ourAlgo) == Algo.ourAlgo)
-        gcry_md_enable(hd, Algo.gcryAlgo);
+        Algos.push_back(Algo.gcryAlgo);
     }
+    Enable(Algos);
   }
 
   explicit PrivateHashes(HashStringList const &Hashes) : FileSize(0)
   {
     maybeInit();
-    gcry_md_open(&hd, 0, 0);
+    std::vector<int> Algos;
     for (auto &Algo : Algorithms)
     {
       if (not Hashes.usable() || Hashes.find(Algo.name) != NULL)
-        gcry_md_enable(hd, Algo.gcryAlgo);
+        Algos.push_back(Algo.gcryAlgo);
     }
+    Enable(Algos);
   }
   ~PrivateHashes()
   {
+    Finish();
+    for (auto &w : Workers)
+      gcry_md_close(w.hd);
     gcry_md_close(hd);
   }
 };
@@ -366,7 +543,7 @@ bool Hashes::Add(const unsigned char *const Data, unsigned long long const Size)
 {
   if (Size != 0)
   {
-    gcry_md_write(d->hd, Data, Size);
+    d->Add(Data, Size);
     d->FileSize += Size;
   }
   return true;
@@ -444,10 +621,11 @@ static APT_PURE std::string HexDigest(gcry_md_hd_t hd, int algo)
 
 HashStringList Hashes::GetHashStringList()
 {
+  d->Finish();
   HashStringList hashes;
   for (auto &Algo : Algorithms)
-    if (gcry_md_is_enabled(d->hd, Algo.gcryAlgo))
-      hashes.push_back(HashString(Algo.name, HexDigest(d->hd, Algo.gcryAlgo)));
+    if (gcry_md_is_enabled(d->Handle(Algo.gcryAlgo), Algo.gcryAlgo))
+      hashes.push_back(HashString(Algo.name, HexDigest(d->Handle(Algo.gcryAlgo), Algo.gcryAlgo)));
   hashes.FileSize(d->FileSize);
 
   return hashes;
@@ -455,9 +633,10 @@ HashStringList Hashes::GetHashStringList()
 
 HashString Hashes::GetHashString(SupportedHashes hash)
 {
+  d->Finish();
   for (auto &Algo : Algorithms)
     if (hash == Algo.ourAlgo)
-      return HashString(Algo.name, HexDigest(d->hd, Algo.gcryAlgo));
+      return HashString(Algo.name, HexDigest(d->Handle(Algo.gcryAlgo), Algo.gcryAlgo));
 
   abort();
 }
@@ -23,6 +23,7 @@
 #include <apt-pkg/macros.h>
 #include <apt-pkg/mmap.h>
 
+#include <algorithm>
 #include <cerrno>
 #include <cstdint>
 #include <cstdlib>
@@ -285,6 +286,11 @@ DynamicMMap::DynamicMMap(unsigned long Flags, unsigned long const &WorkSpace,
 
     if (Base == MAP_FAILED)
       _error->Errno("DynamicMMap", _("Couldn't make mmap of %lu bytes"), WorkSpace);
+#ifdef MADV_HUGEPAGE
+    // only a hint: fewer page faults and TLB misses for large maps
+    else if ((this->Flags & HugePages) == HugePages)
+      madvise(Base, WorkSpace, MADV_HUGEPAGE);
+#endif
 
     iSize = 0;
     return;
@@ -344,6 +350,46 @@ unsigned long DynamicMMap::RawAllocate(unsigned long long Size, unsigned long Al
   return Result;
 }
 /*}}}*/
+// DynamicMMap::LoadFile - Fill the empty map with a file		/*{{{*/
+// ---------------------------------------------------------------------
+/* Only a private anonymous map can be covered by the file, the mapping of
+   the file then is a private layer over the start of the workspace. */
+bool DynamicMMap::LoadFile(FileFd &F)
+{
+  if (unlikely(iSize != 0))
+    return _error->Error("Can't load %s into a map which is already in use", F.Name().c_str());
+  unsigned long long const Size = F.Size();
+
+#if defined(_POSIX_MAPPED_FILES) && defined(MAP_FIXED)
+  if (Fd == 0 && (Flags & (Fallback | Public | ReadOnly)) == 0 &&
+      Size != 0 && Size <= WorkSpace && F.IsCompressed() == false)
+  {
+    if (mmap(Base, Size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, F.Fd(), 0) == Base)
+    {
+      iSize = Size;
+      return true;
+    }
+    // a failed mmap might have removed a part of the workspace already
+#ifdef MAP_ANONYMOUS
+    if (mmap(Base, Size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != Base)
+#else
+    if (mmap(Base, Size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON | MAP_FIXED, -1, 0) != Base)
+#endif
+      return _error->Errno("mmap", _("Couldn't make mmap of %llu bytes"), Size);
+  }
+#endif
+
+  if (F.Seek(0) == false)
+    return false;
+  _error->PushToStack();
+  unsigned long const Start = RawAllocate(Size);
+  bool const newError = _error->PendingError();
+  _error->MergeWithStack();
+  if (Start == 0 && newError)
+    return false;
+  return F.Read(static_cast<char *>(Base) + Start, Size);
+}
+/*}}}*/
 // DynamicMMap::Allocate - Pooled aligned allocation			/*{{{*/
 // ---------------------------------------------------------------------
 /* This allocates an Item of size ItemSize so that it is aligned to its
@@ -389,16 +435,22 @@ unsigned long DynamicMMap::Allocate(unsigned long ItemSize)
     const unsigned long size = 20 * 1024;
     I->Count = size / ItemSize;
     Pool *oldPools = Pools;
-    _error->PushToStack();
-    Result = RawAllocate(size, ItemSize);
-    bool const newError = _error->PendingError();
-    _error->MergeWithStack();
-    if (Pools != oldPools)
-      I = Pools + (I - oldPools);
-
-    // Does the allocation failed ?
-    if (Result == 0 && newError)
-      return 0;
+    // only growing the map can fail, so the error stack is only needed then
+    if (iSize + size + ItemSize <= WorkSpace)
+      Result = RawAllocate(size, ItemSize);
+    else
+    {
+      _error->PushToStack();
+      Result = RawAllocate(size, ItemSize);
+      bool const newError = _error->PendingError();
+      _error->MergeWithStack();
+      if (Pools != oldPools)
+        I = Pools + (I - oldPools);
+
+      // Does the allocation failed ?
+      if (Result == 0 && newError)
+        return 0;
+    }
     I->Start = Result;
   }
   else
@@ -418,13 +470,21 @@ unsigned long DynamicMMap::WriteString(const char *String,
   if (Len == std::numeric_limits<unsigned long>::max())
     Len = strlen(String);
 
-  _error->PushToStack();
-  unsigned long Result = RawAllocate(Len + 1 + sizeof(uint16_t), sizeof(uint16_t));
-  bool const newError = _error->PendingError();
-  _error->MergeWithStack();
+  unsigned long const Size = Len + 1 + sizeof(uint16_t);
+  unsigned long Result;
+  // only growing the map can fail, so the error stack is only needed then
+  if (Base != NULL && iSize + Size + sizeof(uint16_t) <= WorkSpace)
+    Result = RawAllocate(Size, sizeof(uint16_t));
+  else
+  {
+    _error->PushToStack();
+    Result = RawAllocate(Size, sizeof(uint16_t));
+    bool const newError = _error->PendingError();
+    _error->MergeWithStack();
 
-  if (Base == NULL || (Result == 0 && newError))
-    return 0;
+    if (Base == NULL || (Result == 0 && newError))
+      return 0;
+  }
 
   if (Len >= std::numeric_limits<uint16_t>::max())
     abort();
@@ -438,6 +498,28 @@ unsigned long DynamicMMap::WriteString(const char *String,
   return Result;
 }
 /*}}}*/
+#if defined(_POSIX_MAPPED_FILES) && defined(__linux__)
+// MoveToNewMap - Copy a private workspace into a larger one		/*{{{*/
+static void *MoveToNewMap(void *const oldBase, unsigned long const oldSize, unsigned long long const usedSize,
+                          unsigned long long const newSize, bool const HugePages)
+{
+#ifdef MAP_ANONYMOUS
+  void *const newBase = mmap(0, newSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#else
+  void *const newBase = mmap(0, newSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+#endif
+  if (newBase == MAP_FAILED)
+    return MAP_FAILED;
+#ifdef MADV_HUGEPAGE
+  if (HugePages == true)
+    madvise(newBase, newSize, MADV_HUGEPAGE);
+#endif
+  memcpy(newBase, oldBase, usedSize);
+  munmap(oldBase, oldSize);
+  return newBase;
+}
+/*}}}*/
+#endif
 // DynamicMMap::Grow - Grow the mmap					/*{{{*/
 // ---------------------------------------------------------------------
 /* This method is a wrapper around different methods to (try to) grow
@@ -476,6 +558,7 @@ bool DynamicMMap::Grow()
   if ((Flags & Fallback) != Fallback)
   {
 #if defined(_POSIX_MAPPED_FILES) && defined(__linux__)
+    void *const oldBase = Base;
 #ifdef MREMAP_MAYMOVE
 
     if ((Flags & Moveable) == Moveable)
@@ -484,6 +567,12 @@ bool DynamicMMap::Grow()
 #endif
       Base = mremap(Base, WorkSpace, newSize, 0);
 
+    /* mremap can't handle a workspace consisting of several mappings like
+       the file mapped by LoadFile and the anonymous memory behind it */
+    if (Base == MAP_FAILED && errno == EFAULT && Fd == 0 && (Flags & (Moveable | Public)) == Moveable)
+      Base = MoveToNewMap(oldBase, WorkSpace, std::min<unsigned long long>(iSize, WorkSpace), newSize,
+                          (Flags & HugePages) == HugePages);
+
     if (Base == MAP_FAILED)
       return false;
 #else
@@ -63,7 +63,8 @@ class MMap
     ReadOnly = (1 << 2),
     UnMapped = (1 << 3),
     Moveable = (1 << 4),
-    Fallback = (1 << 5)
+    Fallback = (1 << 5),
+    HugePages = (1 << 6)
   };
 
   // Simple accessors
@@ -109,6 +110,13 @@ class DynamicMMap : public MMap
   unsigned long Allocate(unsigned long ItemSize);
   unsigned long WriteString(const char *String, unsigned long Len = std::numeric_limits<unsigned long>::max());
   inline unsigned long WriteString(const std::string &S) { return WriteString(S.c_str(), S.length()); };
+  /** \brief fill the still empty map with the content of the given file
+   *
+   * The file is mapped copy-on-write over the start of the map if possible,
+   * so only the pages changed later on are copied into memory, all others
+   * stay shared with the page cache. Otherwise the file is read.
+   */
+  bool LoadFile(FileFd &F);
   void UsePools(Pool &P, unsigned int Count)
   {
     Pools = &P;
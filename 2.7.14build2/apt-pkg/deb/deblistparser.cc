@@ -17,8 +17,10 @@
 #include <apt-pkg/configuration.h>
 #include <apt-pkg/deblistparser.h>
 #include <apt-pkg/error.h>
+#include <apt-pkg/fileutl.h>
 #include <apt-pkg/hashes.h>
 #include <apt-pkg/macros.h>
+#include <apt-pkg/mmap.h>
 #include <apt-pkg/pkgcache.h>
 #include <apt-pkg/strutl.h>
 #include <apt-pkg/tagfile-keys.h>
@@ -26,10 +28,15 @@
 
 #include <algorithm>
 #include <cctype>
+#include <cinttypes>
 #include <cstddef>
 #include <cstring>
+#include <iostream>
 #include <string>
 #include <vector>
+
+#include <sys/stat.h>
+#include <xxhash.h>
 /*}}}*/
 
 using APT::StringView;
@@ -43,12 +50,78 @@ static const debListParser::WordList PrioList[] = {
    {"extra", pkgCache::State::Extra},
    {"", 0}};
 
+// Fragments - the fields of an index the cache generator uses		/*{{{*/
+// ---------------------------------------------------------------------
+/* A fragment file starts with a signature and a key identifying the index
+   it was created from, followed by a record for each stanza: its offset
+   and size in the index and the stanza reduced to the fields debListParser
+   looks at, so this list has to be kept in sync with the parser. */
+static constexpr char FragmentSignature[] = "APT Fragment 1";
+struct FragmentRecord
+{
+  map_filesize_t Offset;
+  map_filesize_t Size;
+  uint64_t Length;
+};
+static bool IsFragmentField(StringView const Tag)
+{
+  static StringView const Fields[] = {
+     "Package", "Architecture", "Version", "Multi-Arch", "Source", "Section",
+     "Priority", "Size", "Installed-Size", "Essential", "Important", "Protected",
+     "Phased-Update-Percentage", "SHA256", "Pre-Depends", "Depends", "Conflicts",
+     "Breaks", "Recommends", "Suggests", "Replaces", "Enhances", "Provides"};
+  // Description, Description-md5 and the translated ones
+  if (Tag.length() >= strlen("Description") && strncasecmp(Tag.data(), "Description", strlen("Description")) == 0)
+    return true;
+  return std::any_of(std::begin(Fields), std::end(Fields), [&](StringView const F)
+                     { return F.length() == Tag.length() && strncasecmp(F.data(), Tag.data(), F.length()) == 0; });
+}
+static void AddToFragment(std::string &Fragment, pkgTagSection const &Section, map_filesize_t const Offset)
+{
+  FragmentRecord Record{Offset, Section.size(), 0};
+  size_t const RecordPos = Fragment.size();
+  Fragment.append(reinterpret_cast<char const *>(&Record), sizeof(Record));
+  for (unsigned int I = 0; I < Section.Count(); ++I)
+  {
+    const char *Start;
+    const char *Stop;
+    Section.Get(Start, Stop, I);
+    auto const Colon = static_cast<const char *>(memchr(Start, ':', Stop - Start));
+    if (Colon == nullptr)
+      continue;
+    StringView const Tag(Start, Colon - Start);
+    if (IsFragmentField(Tag) == false)
+      continue;
+    // the synopsis is enough to know that a description exists
+    if (Tag.length() >= strlen("Description") && Tag != "Description-md5")
+    {
+      auto const Newline = static_cast<const char *>(memchr(Colon, '\n', Stop - Colon));
+      if (Newline != nullptr)
+        Stop = Newline;
+    }
+    while (Stop != Start && (Stop[-1] == '\n' || Stop[-1] == '\r'))
+      --Stop;
+    Fragment.append(Start, Stop - Start).append(1, '\n');
+  }
+  Fragment.append(1, '\n');
+  Record.Length = Fragment.size() - RecordPos - sizeof(Record);
+  memcpy(&Fragment[RecordPos], &Record, sizeof(Record));
+}
+static std::string FragmentKey(std::string const &IndexFile, map_filesize_t const IndexSize, time_t const IndexMTime)
+{
+  std::string Key;
+  strprintf(Key, "%s\n%llu\n%lld\n%s", IndexFile.c_str(), static_cast<unsigned long long>(IndexSize),
+            static_cast<long long>(IndexMTime), PACKAGE_VERSION);
+  return Key;
+}
+/*}}}*/
+
 // ListParser::debListParser - Constructor				/*{{{*/
 // ---------------------------------------------------------------------
 /* Provide an architecture and only this one and "all" will be accepted
    in Step(), if no Architecture is given we will accept every arch
    we would accept in general with checkArchitecture() */
-debListParser::debListParser(FileFd *File) : pkgCacheListParser(), Tags(File)
+debListParser::debListParser(FileFd *File) : pkgCacheListParser(), RecordFragment(false), Tags(File, pkgTagFile::MMAP)
 {
   // this dance allows an empty value to override the default
   if (_config->Exists("pkgCacheGen::ForceEssential"))
@@ -61,28 +134,29 @@ debListParser::debListParser(FileFd *File) : pkgCacheListParser(), Tags(File)
     forceEssential.emplace_back("apt");
   forceImportant = _config->FindVector("pkgCacheGen::ForceImportant");
   myArch = _config->Find("APT::Architecture");
+  Languages = APT::Configuration::getLanguages(true);
 }
 /*}}}*/
 // ListParser::Package - Return the package name			/*{{{*/
 // ---------------------------------------------------------------------
 /* This is to return the name of the package this section describes */
-string debListParser::Package()
+StringView debListParser::Package()
 {
-  string Result = Section.Find(pkgTagSection::Key::Package).to_string();
+  StringView Result = Section.Find(pkgTagSection::Key::Package);
 
   // Normalize mixed case package names to lower case, like dpkg does
   // See Bug#807012 for details.
   // Only do this when the package name does not contain a / - as that
   // indicates that the package name was derived from a filename given
   // to install or build-dep or similar (Bug#854794)
-  if (likely(Result.find('/') == string::npos))
+  if (likely(Result.find('/') == string::npos) &&
+      unlikely(std::any_of(Result.begin(), Result.end(), [](char const c)
+                           { return tolower_ascii_inline(c) != c; })))
   {
-    for (char &c : Result)
-    {
-      char l = tolower_ascii_inline(c);
-      if (unlikely(l != c))
-        c = l;
-    }
+    PackageBuffer.assign(Result.data(), Result.size());
+    for (char &c : PackageBuffer)
+      c = tolower_ascii_inline(c);
+    Result = PackageBuffer;
   }
 
   if (unlikely(Result.empty() == true))
@@ -129,7 +203,7 @@ unsigned char debListParser::ParseMultiArch(bool const showErrors) /*{{{*/
     {
       if (showErrors == true)
         _error->Warning("Architecture: all package '%s' can't be Multi-Arch: same",
-                        Package().c_str());
+                        Package().to_string().c_str());
       MA = pkgCache::Version::No;
     }
     else
@@ -143,7 +217,7 @@ unsigned char debListParser::ParseMultiArch(bool const showErrors) /*{{{*/
   {
     if (showErrors == true)
       _error->Warning("Unknown Multi-Arch type '%s' for package '%s'",
-                      MultiArch.to_string().c_str(), Package().c_str());
+                      MultiArch.to_string().c_str(), Package().to_string().c_str());
     MA = pkgCache::Version::No;
   }
 
@@ -223,10 +297,7 @@ bool debListParser::NewVersion(pkgCache::VerIterator &Ver)
 
   // Priority
   if (Section.Find(pkgTagSection::Key::Priority, Start, Stop) == true)
-  {
-    if (GrabWord(StringView(Start, Stop - Start), PrioList, Ver->Priority) == false)
-      Ver->Priority = pkgCache::State::Extra;
-  }
+    Ver->Priority = GetPrio(StringView(Start, Stop - Start));
 
   if (ParseDepends(Ver, pkgTagSection::Key::Pre_Depends, pkgCache::Dep::PreDepends) == false)
     return false;
@@ -257,14 +328,15 @@ bool debListParser::NewVersion(pkgCache::VerIterator &Ver)
 }
 /*}}}*/
 // ListParser::AvailableDescriptionLanguages				/*{{{*/
-std::vector<std::string> debListParser::AvailableDescriptionLanguages()
+std::vector<std::string> const &debListParser::AvailableDescriptionLanguages()
 {
-  std::vector<std::string> avail;
+  std::vector<std::string> &avail = AvailableLanguages;
+  avail.clear();
   static constexpr int prefixLen = 12;
   char buf[32] = "Description-";
   if (Section.Exists(pkgTagSection::Key::Description))
     avail.emplace_back();
-  for (auto const &lang : APT::Configuration::getLanguages(true))
+  for (auto const &lang : Languages)
   {
     if (unlikely(lang.size() > sizeof(buf) - prefixLen))
     {
@@ -848,8 +920,9 @@ bool debListParser::ParseDepends(pkgCache::VerIterator &Ver,
   if (Section.Find(Key, Start, Stop) == false || Start == Stop)
     return true;
 
-  string const pkgArch = Ver.Arch();
-  bool const barbarianArch = not APT::Configuration::checkArchitecture(pkgArch);
+  StringView pkgArch = Ver.Arch();
+  pkgCacheGenerator::Dynamic<StringView> DynArch(pkgArch);
+  bool const barbarianArch = not IsKnownArchitecture(pkgArch);
 
   while (1)
   {
@@ -908,21 +981,21 @@ bool debListParser::ParseProvides(pkgCache::VerIterator &Ver)
   /* it is unlikely, but while parsing dependencies, we might have already
      picked up multi-arch implicit provides which we do not want to duplicate here */
   bool hasProvidesAlready = false;
-  std::string const spzName = Ver.ParentPkg().FullName(false);
   {
     for (pkgCache::PrvIterator Prv = Ver.ProvidesList(); Prv.end() == false; ++Prv)
     {
       if (Prv.IsMultiArchImplicit() == false || (Prv->Flags & pkgCache::Flag::ArchSpecific) == 0)
         continue;
-      if (spzName != Prv.OwnerPkg().FullName(false))
+      if (Prv.OwnerPkg() != Ver.ParentPkg())
         continue;
       hasProvidesAlready = true;
       break;
     }
   }
 
-  string const Arch = Ver.Arch();
-  bool const barbarianArch = not APT::Configuration::checkArchitecture(Arch);
+  StringView Arch = Ver.Arch();
+  pkgCacheGenerator::Dynamic<StringView> DynArch(Arch);
+  bool const barbarianArch = not IsKnownArchitecture(Arch);
   const char *Start;
   const char *Stop;
   if (Section.Find(pkgTagSection::Key::Provides, Start, Stop) == true)
@@ -966,7 +1039,8 @@ bool debListParser::ParseProvides(pkgCache::VerIterator &Ver)
       {
         if ((Ver->MultiArch & pkgCache::Version::Allowed) == pkgCache::Version::Allowed && not barbarianArch)
         {
-          if (NewProvides(Ver, Package.to_string().append(":any"), "any", Version, pkgCache::Flag::MultiArchImplicit) == false)
+          NameBuffer.assign(Package.data(), Package.size()).append(":any");
+          if (NewProvides(Ver, NameBuffer, "any", Version, pkgCache::Flag::MultiArchImplicit) == false)
             return false;
         }
         if (NewProvides(Ver, Package, Arch, Version, 0) == false)
@@ -974,13 +1048,11 @@ bool debListParser::ParseProvides(pkgCache::VerIterator &Ver)
       }
       if (archfound == std::string::npos)
       {
-        string spzName = Package.to_string();
-        spzName.push_back(':');
-        spzName.append(Ver.ParentPkg().Arch());
-        pkgCache::PkgIterator const spzPkg = Ver.Cache()->FindPkg(spzName, "any");
+        NameBuffer.assign(Package.data(), Package.size()).append(1, ':').append(Ver.ParentPkg().Arch());
+        pkgCache::PkgIterator const spzPkg = Ver.Cache()->FindPkg(NameBuffer, "any");
         if (spzPkg.end() == false)
         {
-          if (NewProvides(Ver, spzName, "any", Version, pkgCache::Flag::MultiArchImplicit | pkgCache::Flag::ArchSpecific) == false)
+          if (NewProvides(Ver, NameBuffer, "any", Version, pkgCache::Flag::MultiArchImplicit | pkgCache::Flag::ArchSpecific) == false)
             return false;
         }
       }
@@ -991,8 +1063,8 @@ bool debListParser::ParseProvides(pkgCache::VerIterator &Ver)
   {
     if ((Ver->MultiArch & pkgCache::Version::Allowed) == pkgCache::Version::Allowed)
     {
-      string const Package = string(Ver.ParentPkg().Name()).append(":").append("any");
-      if (NewProvides(Ver, Package, "any", Ver.VerStr(), pkgCache::Flag::MultiArchImplicit) == false)
+      NameBuffer.assign(Ver.ParentPkg().Name()).append(":any");
+      if (NewProvides(Ver, NameBuffer, "any", Ver.VerStr(), pkgCache::Flag::MultiArchImplicit) == false)
         return false;
     }
     else if ((Ver->MultiArch & pkgCache::Version::Foreign) == pkgCache::Version::Foreign)
@@ -1004,10 +1076,11 @@ bool debListParser::ParseProvides(pkgCache::VerIterator &Ver)
 
   if (hasProvidesAlready == false)
   {
-    pkgCache::PkgIterator const spzPkg = Ver.Cache()->FindPkg(spzName, "any");
+    NameBuffer.assign(Ver.ParentPkg().Name()).append(1, ':').append(Ver.ParentPkg().Arch());
+    pkgCache::PkgIterator const spzPkg = Ver.Cache()->FindPkg(NameBuffer, "any");
     if (spzPkg.end() == false)
     {
-      if (NewProvides(Ver, spzName, "any", Ver.VerStr(), pkgCache::Flag::MultiArchImplicit | pkgCache::Flag::ArchSpecific) == false)
+      if (NewProvides(Ver, NameBuffer, "any", Ver.VerStr(), pkgCache::Flag::MultiArchImplicit | pkgCache::Flag::ArchSpecific) == false)
         return false;
     }
   }
@@ -1037,13 +1110,21 @@ bool debListParser::GrabWord(StringView Word, WordList const *List, unsigned cha
 bool debListParser::Step()
 {
   iOffset = Tags.Offset();
-  return Tags.Step(Section);
+  if (Tags.Step(Section) == false)
+    return false;
+  if (RecordFragment == true)
+    AddToFragment(Fragment, Section, iOffset);
+  return true;
 }
 /*}}}*/
 // ListParser::GetPrio - Convert the priority from a string		/*{{{*/
 // ---------------------------------------------------------------------
 /* */
 unsigned char debListParser::GetPrio(string Str)
+{
+  return GetPrio(StringView(Str));
+}
+unsigned char debListParser::GetPrio(StringView Str)
 {
   unsigned char Out;
   if (GrabWord(Str, PrioList, Out) == false)
@@ -1087,4 +1168,120 @@ bool debDebFileParser::UsePackage(pkgCache::PkgIterator &Pkg,
   return NewProvides(Ver, DebFile, Pkg.Cache()->NativeArch(), Ver.VerStr(), pkgCache::Flag::MultiArchImplicit | pkgCache::Flag::ArchSpecific);
 }
 
+// ListParser::WriteFragment - Store the kept fields			/*{{{*/
+bool debListParser::WriteFragment(std::string const &IndexFile, map_filesize_t const IndexSize, time_t const IndexMTime)
+{
+  if (RecordFragment == false)
+    return true;
+  RecordFragment = false;
+
+  std::string const FragmentFile = debFragmentListParser::FragmentFile(IndexFile);
+  std::string const Key = FragmentKey(IndexFile, IndexSize, IndexMTime);
+  uint64_t const KeyLength = Key.length();
+
+  _error->PushToStack();
+  FileFd Out;
+  bool Okay = CreateAPTDirectoryIfNeeded(_config->FindDir("Dir::Cache"), flNotFile(FragmentFile)) &&
+              Out.Open(FragmentFile, FileFd::WriteAtomic, FileFd::None, 0644);
+  if (Okay == true)
+  {
+    Out.EraseOnFailure();
+    Okay = Out.Write(FragmentSignature, sizeof(FragmentSignature)) &&
+           Out.Write(&KeyLength, sizeof(KeyLength)) &&
+           Out.Write(Key.data(), Key.length()) &&
+           Out.Write(Fragment.data(), Fragment.length());
+    Okay &= Out.Close();
+  }
+  if (Okay == false && _config->FindB("Debug::pkgCacheGen", false) == true)
+  {
+    std::clog << "Couldn't write fragment " << FragmentFile << " of " << IndexFile << std::endl;
+    _error->DumpErrors(std::clog);
+  }
+  _error->RevertToStack();
+  std::string().swap(Fragment);
+  return Okay;
+}
+/*}}}*/
+
 debListParser::~debListParser() {}
+
+// FragmentListParser - Merge an index from its fragment		/*{{{*/
+debFragmentListParser::debFragmentListParser(FileFd *File) : debListParser(File), Current(nullptr), End(nullptr),
+                                                             StanzaSize(0), IndexSize(0), IndexMTime(0)
+{
+}
+std::string debFragmentListParser::FragmentFile(std::string const &IndexFile)
+{
+  std::string File;
+  strprintf(File, "%s%016" PRIx64 ".bin", _config->FindDir("Dir::Cache::fragments").c_str(),
+            static_cast<uint64_t>(XXH3_64bits(IndexFile.data(), IndexFile.length())));
+  return File;
+}
+debFragmentListParser *debFragmentListParser::Open(FileFd *File, std::string const &IndexFile)
+{
+  struct stat St;
+  if (stat(IndexFile.c_str(), &St) != 0)
+    return nullptr;
+  std::string const FragmentFile = debFragmentListParser::FragmentFile(IndexFile);
+  if (RealFileExists(FragmentFile) == false)
+    return nullptr;
+
+  std::unique_ptr<debFragmentListParser> Parser(new debFragmentListParser(File));
+  _error->PushToStack();
+  Parser->FragmentFd.reset(new FileFd(FragmentFile, FileFd::ReadOnly));
+  if (Parser->FragmentFd->IsOpen() == true && Parser->FragmentFd->FileSize() != 0)
+    Parser->FragmentMap.reset(new MMap(*Parser->FragmentFd, MMap::ReadOnly));
+  bool const Failed = _error->PendingError() || Parser->FragmentMap == nullptr || Parser->FragmentMap->validData() == false;
+  _error->RevertToStack();
+  if (Failed == true)
+    return nullptr;
+
+  // the fragment has to be for this exact index …
+  char const *I = static_cast<char const *>(Parser->FragmentMap->Data());
+  char const *const End = I + Parser->FragmentMap->Size();
+  std::string const Key = FragmentKey(IndexFile, St.st_size, St.st_mtime);
+  uint64_t KeyLength;
+  if (static_cast<size_t>(End - I) < sizeof(FragmentSignature) + sizeof(KeyLength) ||
+      memcmp(I, FragmentSignature, sizeof(FragmentSignature)) != 0)
+    return nullptr;
+  I += sizeof(FragmentSignature);
+  memcpy(&KeyLength, I, sizeof(KeyLength));
+  I += sizeof(KeyLength);
+  if (KeyLength != Key.length() || static_cast<uint64_t>(End - I) < KeyLength || memcmp(I, Key.data(), KeyLength) != 0)
+    return nullptr;
+  I += KeyLength;
+
+  // … and complete, so that Step can trust it
+  for (char const *R = I; R != End;)
+  {
+    FragmentRecord Record;
+    if (static_cast<size_t>(End - R) < sizeof(Record))
+      return nullptr;
+    memcpy(&Record, R, sizeof(Record));
+    R += sizeof(Record);
+    if (static_cast<uint64_t>(End - R) < Record.Length || Record.Length < 2 || R[Record.Length - 1] != '\n' || R[Record.Length - 2] != '\n')
+      return nullptr;
+    R += Record.Length;
+  }
+
+  Parser->Current = I;
+  Parser->End = End;
+  Parser->IndexSize = St.st_size;
+  Parser->IndexMTime = St.st_mtime;
+  return Parser.release();
+}
+bool debFragmentListParser::Step()
+{
+  if (Current == End)
+    return false;
+  FragmentRecord Record;
+  memcpy(&Record, Current, sizeof(Record));
+  Current += sizeof(Record);
+  iOffset = Record.Offset;
+  StanzaSize = Record.Size;
+  bool const Okay = Section.Scan(Current, Record.Length);
+  Current += Record.Length;
+  return Okay;
+}
+debFragmentListParser::~debFragmentListParser() {}
+/*}}}*/
@@ -19,10 +19,12 @@
 #endif
 
 #include <apt-pkg/string_view.h>
+#include <memory>
 #include <string>
 #include <vector>
 
 class FileFd;
+class MMap;
 
 class APT_HIDDEN debListParser : public pkgCacheListParser
 {
@@ -39,6 +41,13 @@ class APT_HIDDEN debListParser : public pkgCacheListParser
   std::vector<std::string> forceImportant;
   std::string MD5Buffer;
   std::string myArch;
+  std::vector<std::string> Languages;
+  // buffers reused for each stanza, so that parsing one doesn't allocate
+  std::string PackageBuffer;
+  std::string NameBuffer;
+  std::vector<std::string> AvailableLanguages;
+  bool RecordFragment;
+  std::string Fragment;
 
   protected:
   pkgTagFile Tags;
@@ -55,14 +64,15 @@ class APT_HIDDEN debListParser : public pkgCacheListParser
 
   public:
   APT_PUBLIC static unsigned char GetPrio(std::string Str);
+  APT_HIDDEN static unsigned char GetPrio(APT::StringView Str);
 
   // These all operate against the current section
-  virtual std::string Package() APT_OVERRIDE;
+  virtual APT::StringView Package() APT_OVERRIDE;
   virtual bool ArchitectureAll() APT_OVERRIDE;
   virtual APT::StringView Architecture() APT_OVERRIDE;
   virtual APT::StringView Version() APT_OVERRIDE;
   virtual bool NewVersion(pkgCache::VerIterator &Ver) APT_OVERRIDE;
-  virtual std::vector<std::string> AvailableDescriptionLanguages() APT_OVERRIDE;
+  virtual std::vector<std::string> const &AvailableDescriptionLanguages() APT_OVERRIDE;
   virtual APT::StringView Description_md5() APT_OVERRIDE;
   virtual uint32_t VersionHash() APT_OVERRIDE;
   virtual bool SameVersion(uint32_t Hash, pkgCache::VerIterator const &Ver) APT_OVERRIDE;
@@ -96,9 +106,64 @@ class APT_HIDDEN debListParser : public pkgCacheListParser
   {
     return Section.Find(pkgTagSection::Key::SHA256);
   }
+  /** read the complete index into memory, see pkgTagFile::Preload */
+  bool Preload()
+  {
+    return Tags.Preload();
+  }
+  /** keep the fields the cache generator uses of all stanzas from now on */
+  void StartFragment()
+  {
+    RecordFragment = true;
+  }
+  /** \brief store the fields kept since #StartFragment as fragment of the index
+   *
+   * Does nothing if the fragment wasn't started. Failing to write it is not
+   * an error, the index is just parsed again the next time.
+   */
+  bool WriteFragment(std::string const &IndexFile, map_filesize_t const IndexSize, time_t const IndexMTime);
 #endif
 };
 
+#ifdef APT_COMPILING_APT
+/** \brief merges an index from its fragment instead of parsing the index
+ *
+ * A fragment holds only the fields the cache generator uses of each stanza
+ * of an index, so they can be merged without decompressing the index and
+ * scanning all the other fields. The stanzas still go through debListParser
+ * as the result of merging them depends on what is in the cache already.
+ */
+class APT_HIDDEN debFragmentListParser : public debListParser
+{
+  std::unique_ptr<FileFd> FragmentFd;
+  std::unique_ptr<MMap> FragmentMap;
+  char const *Current;
+  char const *End;
+  map_filesize_t StanzaSize;
+  map_filesize_t IndexSize;
+  time_t IndexMTime;
+
+  public:
+  virtual map_filesize_t Size() APT_OVERRIDE { return StanzaSize; };
+  virtual bool Step() APT_OVERRIDE;
+
+  map_filesize_t GetIndexSize() const { return IndexSize; }
+  time_t GetIndexMTime() const { return IndexMTime; }
+
+  /** \return the file the fragment of the given index is stored in */
+  static std::string FragmentFile(std::string const &IndexFile);
+  /** \brief opens the fragment of the given index
+   *
+   * \param File has to stay closed, it is only used to satisfy debListParser
+   * \return \b nullptr if there is no fragment matching the current index
+   */
+  static debFragmentListParser *Open(FileFd *File, std::string const &IndexFile);
+
+  explicit debFragmentListParser(FileFd *File);
+  virtual ~debFragmentListParser();
+};
+#endif
+
 class APT_HIDDEN debDebFileParser : public debListParser
 {
   private:
@@ -50,9 +50,10 @@ bool edspLikeListParser::NewVersion(pkgCache::VerIterator &Ver)
 // ListParser::Description - Return the description string		/*{{{*/
 // ---------------------------------------------------------------------
 /* Sorry, no description for the resolvers… */
-std::vector<std::string> edspLikeListParser::AvailableDescriptionLanguages()
+std::vector<std::string> const &edspLikeListParser::AvailableDescriptionLanguages()
 {
-  return {};
+  static std::vector<std::string> const none;
+  return none;
 }
 APT::StringView edspLikeListParser::Description_md5()
 {
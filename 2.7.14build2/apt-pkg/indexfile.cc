@@ -323,20 +323,40 @@ pkgCacheListParser *pkgDebianIndexFile::CreateListParser(FileFd &Pkg)
   _error->MergeWithStack();
   return newError ? nullptr : Parser.release();
 }
-bool pkgDebianIndexFile::Merge(pkgCacheGenerator &Gen, OpProgress *const Prog)
+bool pkgDebianIndexFile::OpenListParser(std::unique_ptr<FileFd> &Pkg, std::unique_ptr<pkgCacheListParser> &Parser)
 {
-  std::string const PackageFile = IndexFileName();
-  FileFd Pkg;
-  if (OpenListFile(Pkg, PackageFile) == false)
+  Pkg.reset(new FileFd());
+  std::string const FileName = IndexFileName();
+  // only the Packages files are worth it, the others are small or volatile
+  bool const UseFragment = _config->FindB("APT::Cache-Fragments", false) &&
+                           dynamic_cast<debPackagesIndex const *>(this) != nullptr;
+  if (UseFragment == true)
+  {
+    Parser.reset(debFragmentListParser::Open(Pkg.get(), FileName));
+    if (Parser != nullptr)
+      return true;
+  }
+  if (OpenListFile(*Pkg, FileName) == false)
     return false;
   _error->PushToStack();
-  std::unique_ptr<pkgCacheListParser> Parser(CreateListParser(Pkg));
+  Parser.reset(CreateListParser(*Pkg));
   bool const newError = _error->PendingError();
   _error->MergeWithStack();
-  if (newError == false && Parser == nullptr)
-    return true;
-  if (Parser == NULL)
+  auto const DebList = dynamic_cast<debListParser *>(Parser.get());
+  if (UseFragment == true && DebList != nullptr)
+    DebList->StartFragment();
+  return newError == false || Parser != nullptr;
+}
+bool pkgDebianIndexFile::Merge(pkgCacheGenerator &Gen, OpProgress *const Prog)
+{
+  std::string const PackageFile = IndexFileName();
+  std::unique_ptr<FileFd> Pkg;
+  std::unique_ptr<pkgCacheListParser> Parser;
+  if (Gen.TakePreloadedIndex(this, Pkg, Parser) == false &&
+      OpenListParser(Pkg, Parser) == false)
     return false;
+  if (Parser == nullptr)
+    return true;
 
   if (Prog != NULL)
     Prog->SubProgress(0, GetProgressDescription());
@@ -347,14 +367,30 @@ bool pkgDebianIndexFile::Merge(pkgCacheGenerator &Gen, OpProgress *const Prog)
   // Store the IMS information
   pkgCache::PkgFileIterator File = Gen.GetCurFile();
   pkgCacheGenerator::Dynamic<pkgCache::PkgFileIterator> DynFile(File);
-  File->Size = Pkg.FileSize();
-  File->mtime = Pkg.ModificationTime();
+  auto const Fragment = dynamic_cast<debFragmentListParser *>(Parser.get());
+  if (Fragment != nullptr)
+  {
+    File->Size = Fragment->GetIndexSize();
+    File->mtime = Fragment->GetIndexMTime();
+  }
+  else
+  {
+    File->Size = Pkg->FileSize();
+    File->mtime = Pkg->ModificationTime();
+  }
 
   if (Gen.MergeList(*Parser) == false)
     return _error->Error("Problem with MergeList %s", PackageFile.c_str());
+  auto const DebList = dynamic_cast<debListParser *>(Parser.get());
+  if (DebList != nullptr)
+    DebList->WriteFragment(PackageFile, File->Size, File->mtime);
   return true;
 }
 pkgCache::PkgFileIterator pkgDebianIndexFile::FindInCache(pkgCache &Cache) const
+{
+  return FindInCache(Cache, true);
+}
+pkgCache::PkgFileIterator pkgDebianIndexFile::FindInCache(pkgCache &Cache, bool const ModifyCheck) const
 {
   std::string const FileName = IndexFileName();
   pkgCache::PkgFileIterator File = Cache.FileBegin();
@@ -363,6 +399,9 @@ pkgCache::PkgFileIterator pkgDebianIndexFile::FindInCache(pkgCache &Cache) const
     if (File.FileName() == NULL || FileName != File.FileName())
       continue;
 
+    if (ModifyCheck == false)
+      return File;
+
     struct stat St;
     if (stat(File.FileName(), &St) != 0)
     {
@@ -27,6 +27,7 @@
 #include <apt-pkg/srcrecords.h>
 
 #include <map>
+#include <memory>
 #include <string>
 
 class pkgCacheGenerator;
@@ -163,6 +164,16 @@ class APT_PUBLIC pkgDebianIndexFile : public pkgIndexFile
   public:
   virtual bool Merge(pkgCacheGenerator &Gen, OpProgress *const Prog) APT_OVERRIDE;
   virtual pkgCache::PkgFileIterator FindInCache(pkgCache &Cache) const APT_OVERRIDE;
+  /** \brief finds the package file for this index, with \b ModifyCheck only if it is unchanged */
+  APT_HIDDEN pkgCache::PkgFileIterator FindInCache(pkgCache &Cache, bool const ModifyCheck) const;
+
+  /** \brief opens the index and creates the parser #Merge will feed to the generator
+   *
+   * This does not touch the cache, so it can be used to prepare the merge
+   * in another thread. A \b nullptr as Parser indicates that there is
+   * nothing to merge from this index.
+   */
+  APT_HIDDEN bool OpenListParser(std::unique_ptr<FileFd> &Pkg, std::unique_ptr<pkgCacheListParser> &Parser);
 
   explicit pkgDebianIndexFile(bool const Trusted);
   virtual ~pkgDebianIndexFile();
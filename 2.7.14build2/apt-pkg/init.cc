@@ -135,12 +135,14 @@ bool pkgInitConfig(Configuration &Cnf)
   Cnf.CndSet("Dir::State", &STATE_DIR[1]);
   Cnf.CndSet("Dir::State::lists", "lists/");
   Cnf.CndSet("Dir::State::cdroms", "cdroms.list");
+  Cnf.CndSet("Dir::State::compression_rates", "compression_rates");
 
   // Cache
   Cnf.CndSet("Dir::Cache", &CACHE_DIR[1]);
   Cnf.CndSet("Dir::Cache::archives", "archives/");
   Cnf.CndSet("Dir::Cache::srcpkgcache", "srcpkgcache.bin");
   Cnf.CndSet("Dir::Cache::pkgcache", "pkgcache.bin");
+  Cnf.CndSet("Dir::Cache::fragments", "fragments/");
 
   // Configuration
   Cnf.CndSet("Dir::Etc", &CONF_DIR[1]);
@@ -32,10 +32,13 @@
 #include <apt-pkg/version.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cstddef>
 #include <cstring>
 #include <sstream>
 #include <string>
+#include <system_error>
+#include <thread>
 #include <vector>
 #include <sys/stat.h>
 #include <xxhash.h>
@@ -58,7 +61,7 @@ pkgCache::Header::Header()
 
   /* Whenever the structures change the major version should be bumped,
      whenever the generator changes the minor version should be bumped. */
-  APT_HEADER_SET(MajorVersion, 16);
+  APT_HEADER_SET(MajorVersion, 19);
   APT_HEADER_SET(MinorVersion, 0);
   APT_HEADER_SET(Dirty, false);
 
@@ -99,6 +102,15 @@ pkgCache::Header::Header()
   memset(Pools, 0, sizeof(Pools));
 
   CacheFileSize = 0;
+  IndexSize = 0;
+  GrpIndex = 0;
+  GrpIndexSize = 0;
+  GrpIndexValid = false;
+  memset(SegmentHash, 0, sizeof(SegmentHash));
+  StrIndex = 0;
+  StrIndexSize = 0;
+  StrIndexCount = 0;
+  GarbageSize = 0;
 }
 /*}}}*/
 // Cache::Header::CheckSizes - Check if the two headers have same *sz	/*{{{*/
@@ -194,9 +206,15 @@ bool pkgCache::ReMap(bool const &Errorchecks)
       list != StrP + HeaderP->GetArchitectures())
     return _error->Error(_("The package cache was built for different architectures: %s vs %s"), StrP + HeaderP->GetArchitectures(), list.c_str());
 
-  auto hash = CacheHash();
+  uint64_t Segments[APT_ARRAY_SIZE(HeaderP->SegmentHash)];
+  auto hash = CacheHash(Segments);
   if (_config->FindB("Debug::pkgCacheGen", false))
+  {
     std::clog << "Opened cache with hash " << hash << ", expecting " << HeaderP->CacheFileSize << "\n";
+    for (size_t S = 0; S < APT_ARRAY_SIZE(Segments); ++S)
+      if (Segments[S] != HeaderP->SegmentHash[S])
+        std::clog << "Segment " << S << " of the cache has the wrong hash\n";
+  }
   if (hash != HeaderP->CacheFileSize)
     return _error->Error(_("The package cache file is corrupted, it has the wrong hash"));
 
@@ -229,19 +247,60 @@ map_id_t pkgCache::sHash(StringView Str) const
     Hash = 33u * Hash + tolower_ascii_unsafe(*I);
   return Hash % HeaderP->GetHashTableSize();
 }
-uint32_t pkgCache::CacheHash()
+// Cache::CacheHash - Hash of the complete cache				/*{{{*/
+// ---------------------------------------------------------------------
+/* The cache after the header is split into at most as many segments as the
+   header has room for, each at least 4 MiB large, which are hashed by up to
+   APT::Cache-Threads threads at once. Caches smaller than that are hashed
+   by the calling thread alone as starting threads would cost more. */
+uint32_t pkgCache::CacheHash(uint64_t *Segments)
 {
   pkgCache::Header header = {};
-  XXH3_state_t *state = XXH3_createState();
 
   if (Map.Size() < sizeof(header))
     return 0;
 
-  XXH3_64bits_reset(state);
   memcpy(&header, GetMap().Data(), sizeof(header));
 
+  auto const Data = static_cast<const unsigned char *>(GetMap().Data()) + sizeof(header);
+  size_t const DataSize = GetMap().Size() - sizeof(header);
+  size_t const MaxSegments = APT_ARRAY_SIZE(header.SegmentHash);
+  size_t const SegmentSize = std::max<size_t>(4 * 1024 * 1024, (DataSize + MaxSegments - 1) / MaxSegments);
+  size_t const SegmentCount = (DataSize + SegmentSize - 1) / SegmentSize;
+
+  uint64_t Hashes[APT_ARRAY_SIZE(header.SegmentHash)] = {};
+  std::atomic<size_t> NextSegment{0};
+  auto const HashSegments = [&]() {
+    for (size_t S = NextSegment++; S < SegmentCount; S = NextSegment++)
+      Hashes[S] = XXH3_64bits(Data + S * SegmentSize, std::min(SegmentSize, DataSize - S * SegmentSize));
+  };
+  int const Threads = _config->FindI("APT::Cache-Threads", std::thread::hardware_concurrency());
+  std::vector<std::thread> Helpers;
+  for (size_t I = 1; I < SegmentCount && static_cast<int>(I) < Threads; ++I)
+  {
+    try
+    {
+      Helpers.emplace_back(HashSegments);
+    }
+    catch (std::system_error const &)
+    {
+      // the segments are picked up by the threads we have
+      break;
+    }
+  }
+  HashSegments();
+  for (auto &Helper : Helpers)
+    Helper.join();
+
+  if (Segments != nullptr)
+    memcpy(Segments, Hashes, sizeof(Hashes));
+
   header.Dirty = false;
   header.CacheFileSize = 0;
+  memcpy(header.SegmentHash, Hashes, sizeof(Hashes));
+
+  XXH3_state_t *state = XXH3_createState();
+  XXH3_64bits_reset(state);
 
   XXH3_64bits_update(state,
                      reinterpret_cast<const unsigned char *>(PACKAGE_VERSION),
@@ -251,13 +310,6 @@ uint32_t pkgCache::CacheHash()
                      reinterpret_cast<const unsigned char *>(&header),
                      sizeof(header));
 
-  if (Map.Size() > sizeof(header))
-  {
-    XXH3_64bits_update(state,
-                       static_cast<const unsigned char *>(GetMap().Data()) + sizeof(header),
-                       GetMap().Size() - sizeof(header));
-  }
-
   auto const digest = XXH3_64bits_digest(state);
   XXH3_freeState(state);
   return digest & 0xFFFFFFFF;
@@ -295,6 +347,12 @@ pkgCache::PkgIterator pkgCache::FindPkg(StringView Name, StringView Arch)
   return Grp.FindPkg(Arch);
 }
 /*}}}*/
+// Cache::GroupIndexHash - Hash a group name for the GrpIndex		/*{{{*/
+uint32_t pkgCache::GroupIndexHash(StringView Name)
+{
+  return XXH3_64bits(Name.data(), Name.size()) & 0xFFFFFFFF;
+}
+/*}}}*/
 // Cache::FindGrp - Locate a group by name				/*{{{*/
 // ---------------------------------------------------------------------
 /* Returns End-Pointer on error, pointer to the group otherwise */
@@ -303,6 +361,22 @@ pkgCache::GrpIterator pkgCache::FindGrp(StringView Name)
   if (unlikely(Name.empty() == true))
     return GrpIterator(*this, 0);
 
+  if (HeaderP->GrpIndexValid == true)
+  {
+    GroupIndexSlot *const Slots = HeaderP->GrpIndexP();
+    uint32_t const Mask = HeaderP->GrpIndexSize - 1;
+    uint32_t const Hash = GroupIndexHash(Name);
+    for (uint32_t I = Hash & Mask, Distance = 0;; I = (I + 1) & Mask, ++Distance)
+    {
+      GroupIndexSlot *const Slot = Slots + I;
+      // the group would have displaced a group further away from its slot
+      if (Slot->Grp == 0 || ((I - Slot->Hash) & Mask) < Distance)
+        return GrpIterator(*this, 0);
+      if (Slot->Hash == Hash && StringViewCompareFast(Name, ViewString((GrpP + Slot->Grp)->Name)) == 0)
+        return GrpIterator(*this, GrpP + Slot->Grp);
+    }
+  }
+
   // Look at the hash bucket for the group
   Group *Grp = GrpP + HeaderP->GrpHashTableP()[sHash(Name)];
   for (; Grp != GrpP; Grp = GrpP + Grp->Next)
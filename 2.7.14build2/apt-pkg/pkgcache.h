@@ -149,6 +149,8 @@ class APT_PUBLIC pkgCache /*{{{*/
   struct StringItem;
   struct VerFile;
   struct DescFile;
+  struct GroupIndexSlot;
+  struct StringIndexSlot;
 
   // Iterators
   template <typename Str, typename Itr>
@@ -303,7 +305,13 @@ class APT_PUBLIC pkgCache /*{{{*/
   // String hashing function (512 range)
   inline map_id_t Hash(APT::StringView S) const { return sHash(S); }
 
-  APT_HIDDEN uint32_t CacheHash();
+  /** \brief hash of the complete cache
+   *
+   * \param Segments receives the hashes of the segments of the cache, see
+   * Header::SegmentHash, if given.
+   */
+  APT_HIDDEN uint32_t CacheHash(uint64_t *Segments = nullptr);
+  APT_HIDDEN static uint32_t GroupIndexHash(APT::StringView Name);
 
   // Useful transformation things
   static const char *Priority(unsigned char Priority);
@@ -458,10 +466,84 @@ struct pkgCache::Header
   /** \brief Hash of the file (TODO: Rename) */
   map_filesize_small_t CacheFileSize;
 
+  /** \brief Size of the index files merged into the cache
+
+      Together with the size of the cache this predicts how large the cache
+      built the next time will be, so the generator can reserve enough space
+      for it right away. */
+  map_filesize_t IndexSize;
+
+  /** \brief open addressing table of all groups for quick lookups by name
+
+      The generator builds it when the cache is written, it covers all groups
+      only as long as GrpIndexValid is set. GrpIndexSize is the number of
+      slots in the table, a power of two. */
+  map_pointer<GroupIndexSlot> GrpIndex;
+  uint32_t GrpIndexSize;
+  bool GrpIndexValid;
+#ifdef APT_COMPILING_APT
+  GroupIndexSlot *GrpIndexP() const { return (GroupIndexSlot *)(this) + GrpIndex; }
+#endif
+
+  /** \brief hashes of the segments the cache after this header is split into
+
+      The segments are hashed independently of each other, so that they can
+      be verified in parallel when the cache is opened. The hash of the file
+      in CacheFileSize covers the header including these hashes. */
+  uint64_t SegmentHash[64];
+
+  /** \brief open addressing table of the strings shared between structures
+
+      The generator stores each of these strings only once, the table keeps
+      track of them across generator runs, so that a cache loaded back to
+      add more files to it reuses the strings it already has. StrIndexSize
+      is the number of slots in the table, a power of two, of which
+      StrIndexCount are used. */
+  map_pointer<StringIndexSlot> StrIndex;
+  uint32_t StrIndexSize;
+  uint32_t StrIndexCount;
+#ifdef APT_COMPILING_APT
+  StringIndexSlot *StrIndexP() const { return (StringIndexSlot *)(this) + StrIndex; }
+#endif
+
+  /** \brief bytes of the structures unlinked from the cache
+
+      Updating a cache in place leaves the structures of the dropped
+      versions unreachable in the map. Once they outweigh the rest, the
+      cache is built from scratch again instead. */
+  map_filesize_t GarbageSize;
+
   bool CheckSizes(Header &Against) const APT_PURE;
   Header();
 };
 /*}}}*/
+// GroupIndexSlot structure						/*{{{*/
+/** \brief a slot in the pkgCache::Header::GrpIndex table
+
+    Groups are stored with Robin Hood hashing starting at the slot given by
+    the lower bits of their Hash, so a lookup only has to compare the few
+    slots following it - usually all in the same cache line - and only
+    dereferences the group if the full hash matches. */
+struct pkgCache::GroupIndexSlot
+{
+  /** \brief pkgCache::GroupIndexHash of the name of the group */
+  uint32_t Hash;
+  /** \brief the group in this slot, an empty slot has none */
+  map_pointer<Group> Grp;
+};
+/*}}}*/
+// StringIndexSlot structure						/*{{{*/
+/** \brief a slot in the pkgCache::Header::StrIndex table
+
+    Stored with Robin Hood hashing just like the GroupIndexSlot. */
+struct pkgCache::StringIndexSlot
+{
+  /** \brief lower 32 bits of the XXH3 hash of the string */
+  uint32_t Hash;
+  /** \brief the string in this slot, an empty slot has none */
+  map_stringitem_t String;
+};
+/*}}}*/
 // Group structure							/*{{{*/
 /** \brief groups architecture depending packages together
 
@@ -763,6 +845,12 @@ struct pkgCache::Version
 struct pkgCache::Version::Extra
 {
   uint8_t PhasedUpdatePercentage;
+  /** \brief hash of the SHA256 of this version, 0 if unknown
+
+      Versions with the same version string and hash can still differ in
+      their content. Storing it lets the generator tell such versions apart
+      even if it is updating a cache loaded from disk. */
+  uint64_t SHA256Hash;
 };
 #endif
 /*}}}*/
@@ -11,6 +11,7 @@
 // Include Files							/*{{{*/
 #include <config.h>
 
+#include <apt-pkg/aptconfiguration.h>
 #include <apt-pkg/configuration.h>
 #include <apt-pkg/deblistparser.h>
 #include <apt-pkg/error.h>
@@ -27,11 +28,19 @@
 #include <apt-pkg/version.h>
 
 #include <algorithm>
+#include <bitset>
+#include <condition_variable>
 #include <cstddef>
 #include <cstring>
 #include <iostream>
+#include <iterator>
+#include <limits>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_set>
 #include <vector>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -48,6 +57,8 @@ std::vector<Iter *> pkgCacheGenerator::Dynamic<Iter>::toReMap;
 
 static bool IsDuplicateDescription(pkgCache &Cache, pkgCache::DescIterator Desc,
                                    APT::StringView CurMd5, std::string const &CurLang);
+static void ShareDescriptionList(pkgCache &Cache, pkgCache::VerIterator &Ver,
+                                 APT::StringView CurMd5);
 
 using APT::StringView;
 using std::string;
@@ -69,7 +80,8 @@ static inline uint32_t NarrowOffset(T ptr)
 // ---------------------------------------------------------------------
 /* We set the dirty flag and make sure that is written to the disk */
 pkgCacheGenerator::pkgCacheGenerator(DynamicMMap *pMap, OpProgress *Prog) : Map(*pMap), Cache(pMap, false), Progress(Prog),
-                                                                            CurrentRlsFile(nullptr), CurrentFile(nullptr), d(nullptr)
+                                                                            CurrentRlsFile(nullptr), CurrentFile(nullptr), d(nullptr),
+                                                                            Preloader(nullptr)
 {
 }
 bool pkgCacheGenerator::Start()
@@ -124,7 +136,7 @@ bool pkgCacheGenerator::Start()
     Cache.HeaderP->SetArchitectures(idxArchitectures);
 
     // Calculate the hash for the empty map, so ReMap does not fail
-    Cache.HeaderP->CacheFileSize = Cache.CacheHash();
+    Cache.HeaderP->CacheFileSize = Cache.CacheHash(Cache.HeaderP->SegmentHash);
     Cache.ReMap();
   }
   else
@@ -153,7 +165,7 @@ pkgCacheGenerator::~pkgCacheGenerator()
     return;
 
   Cache.HeaderP->Dirty = false;
-  Cache.HeaderP->CacheFileSize = Cache.CacheHash();
+  Cache.HeaderP->CacheFileSize = Cache.CacheHash(Cache.HeaderP->SegmentHash);
 
   if (_config->FindB("Debug::pkgCacheGen", false))
     std::clog << "Produced cache with hash " << Cache.HeaderP->CacheFileSize << std::endl;
@@ -252,7 +264,7 @@ bool pkgCacheGenerator::MergeList(ListParser &List,
   unsigned int Counter = 0;
   while (List.Step() == true)
   {
-    string const PackageName = List.Package();
+    StringView const PackageName = List.Package();
     if (PackageName.empty() == true)
       return false;
 
@@ -279,7 +291,7 @@ bool pkgCacheGenerator::MergeList(ListParser &List,
       // TRANSLATOR: The first placeholder is a package name,
       // the other two should be copied verbatim as they include debug info
       return _error->Error(_("Error occurred while processing %s (%s%d)"),
-                           PackageName.c_str(), "NewPackage", 1);
+                           PackageName.to_string().c_str(), "NewPackage", 1);
 
     if (Version.empty() == true)
     {
@@ -312,7 +324,7 @@ bool pkgCacheGenerator::MergeList(ListParser &List,
   return true;
 }
 // CacheGenerator::MergeListGroup					/*{{{*/
-bool pkgCacheGenerator::MergeListGroup(ListParser &List, std::string const &GrpName)
+bool pkgCacheGenerator::MergeListGroup(ListParser &List, StringView GrpName)
 {
   pkgCache::GrpIterator Grp = Cache.FindGrp(GrpName);
   // a group has no data on it's own, only packages have it but these
@@ -344,7 +356,7 @@ bool pkgCacheGenerator::MergeListPackage(ListParser &List, pkgCache::PkgIterator
 
   // Find the right version to write the description
   StringView CurMd5 = List.Description_md5();
-  std::vector<std::string> availDesc = List.AvailableDescriptionLanguages();
+  std::vector<std::string> const &availDesc = List.AvailableDescriptionLanguages();
   for (Ver = Pkg.VersionList(); Ver.end() == false; ++Ver)
   {
     pkgCache::DescIterator VerDesc = Ver.DescriptionList();
@@ -387,6 +399,7 @@ bool pkgCacheGenerator::MergeListVersion(ListParser &List, pkgCache::PkgIterator
   auto DebList = dynamic_cast<debListParser *>(&List);
   if (DebList != nullptr)
     ListSHA256 = DebList->SHA256();
+  uint64_t const ListSHA256Hash = ListSHA256.empty() ? 0 : XXH3_64bits(ListSHA256.data(), ListSHA256.size());
   if (Ver.end() == false)
   {
     /* We know the list is sorted so we use that fact in the search.
@@ -405,11 +418,12 @@ bool pkgCacheGenerator::MergeListVersion(ListParser &List, pkgCache::PkgIterator
       {
         if (List.SameVersion(Hash, Ver))
         {
+          auto const VerSHA256Hash = (static_cast<pkgCache::Version::Extra *>(Map.Data()) + Ver->d)->SHA256Hash;
           // We do not have SHA256 for both, so we cannot compare them, trust the call from SameVersion()
-          if (ListSHA256.empty() || VersionExtra[Ver->ID].SHA256[0] == 0)
+          if (ListSHA256Hash == 0 || VerSHA256Hash == 0)
             break;
           // We have SHA256 for both, so they must match.
-          if (ListSHA256 == APT::StringView(VersionExtra[Ver->ID].SHA256, 64))
+          if (ListSHA256Hash == VerSHA256Hash)
             break;
           if (Debug)
             std::cerr << "Found differing SHA256 for " << Pkg.Name() << "=" << Version.to_string() << std::endl;
@@ -425,6 +439,14 @@ bool pkgCacheGenerator::MergeListVersion(ListParser &List, pkgCache::PkgIterator
           if (VF.end() == true)
             break;
         }
+
+        // keep the file order for an index merged again (RecycleFiles)
+        if (CurrentFile != nullptr && Ver->FileList != 0 &&
+            Ver.FileList().File()->ID > CurrentFile->ID)
+        {
+          Res = 1;
+          break;
+        }
       }
       // proceed with the next till we have either the right
       // or we found another version (which will be lower)
@@ -437,10 +459,36 @@ bool pkgCacheGenerator::MergeListVersion(ListParser &List, pkgCache::PkgIterator
         return _error->Error(_("Error occurred while processing %s (%s%d)"),
                              Pkg.Name(), "UsePackage", 2);
 
+      /* An index merged again (RecycleFiles) can come before the files which
+         provide this version now, so it has to provide the descriptions it
+         would have provided if it had created this version */
+      bool const FirstFile = CurrentFile != nullptr && Ver->FileList != 0 &&
+                             Ver.FileList().File()->ID > CurrentFile->ID;
+
       if (NewFileVer(Ver, List) == false)
         return _error->Error(_("Error occurred while processing %s (%s%d)"),
                              Pkg.Name(), "NewFileVer", 1);
 
+      if (FirstFile && OutVer == 0)
+      {
+        StringView CurMd5 = List.Description_md5();
+        if (Ver->DescriptionList == 0)
+          ShareDescriptionList(Cache, Ver, CurMd5);
+        pkgCache::DescIterator VerDesc = Ver.DescriptionList();
+        if (VerDesc.end() == true || Cache.ViewString(VerDesc->md5sum) == CurMd5)
+        {
+          map_stringitem_t md5idx = VerDesc.end() ? 0 : VerDesc->md5sum;
+          std::vector<std::string> const &availDesc = List.AvailableDescriptionLanguages();
+          for (std::vector<std::string>::const_iterator CurLang = availDesc.begin(); CurLang != availDesc.end(); ++CurLang)
+          {
+            if (IsDuplicateDescription(Cache, Ver.DescriptionList(), CurMd5, *CurLang) == true)
+              continue;
+            if (AddNewDescription(List, Ver, *CurLang, CurMd5, md5idx) == false)
+              return false;
+          }
+        }
+      }
+
       // Read only a single record and return
       if (OutVer != 0)
       {
@@ -462,7 +510,7 @@ bool pkgCacheGenerator::MergeListVersion(ListParser &List, pkgCache::PkgIterator
     LastVer = static_cast<map_pointer<pkgCache::Version> *>(Map.Data()) + (LastVer - static_cast<map_pointer<pkgCache::Version> const *>(oldMap));
   *LastVer = verindex;
   if (ListSHA256.size() == 64)
-    memcpy(VersionExtra[Ver->ID].SHA256, ListSHA256.data(), 64);
+    (static_cast<pkgCache::Version::Extra *>(Map.Data()) + Ver->d)->SHA256Hash = ListSHA256Hash;
 
   if (unlikely(List.NewVersion(Ver) == false))
     return _error->Error(_("Error occurred while processing %s (%s%d)"),
@@ -512,24 +560,11 @@ bool pkgCacheGenerator::MergeListVersion(ListParser &List, pkgCache::PkgIterator
   /* Record the Description(s) based on their master md5sum */
   StringView CurMd5 = List.Description_md5();
 
-  /* Before we add a new description we first search in the group for
-     a version with a description of the same MD5 - if so we reuse this
-     description group instead of creating our own for this version */
-  for (pkgCache::PkgIterator P = Grp.PackageList();
-       P.end() == false; P = Grp.NextPkg(P))
-  {
-    for (pkgCache::VerIterator V = P.VersionList();
-         V.end() == false; ++V)
-    {
-      if (V->DescriptionList == 0 || Cache.ViewString(V.DescriptionList()->md5sum) != CurMd5)
-        continue;
-      Ver->DescriptionList = V->DescriptionList;
-    }
-  }
+  ShareDescriptionList(Cache, Ver, CurMd5);
 
   // We haven't found reusable descriptions, so add the first description(s)
   map_stringitem_t md5idx = Ver->DescriptionList == 0 ? 0 : Ver.DescriptionList()->md5sum;
-  std::vector<std::string> availDesc = List.AvailableDescriptionLanguages();
+  std::vector<std::string> const &availDesc = List.AvailableDescriptionLanguages();
   for (std::vector<std::string>::const_iterator CurLang = availDesc.begin(); CurLang != availDesc.end(); ++CurLang)
     if (AddNewDescription(List, Ver, *CurLang, CurMd5, md5idx) == false)
       return false;
@@ -597,6 +632,130 @@ bool pkgCacheGenerator::NewGroup(pkgCache::GrpIterator &Grp, StringView Name)
   *insertAt = Group;
 
   Grp->ID = Cache.HeaderP->GroupCount++;
+  Cache.HeaderP->GrpIndexValid = false;
+  return true;
+}
+/*}}}*/
+// CacheGenerator::BuildGroupIndex - Index all groups for FindGrp	/*{{{*/
+// ---------------------------------------------------------------------
+/* The table is rebuilt in place if it is still large enough, so caches
+   loaded back to add a few groups don't pile up outdated tables. */
+bool pkgCacheGenerator::BuildGroupIndex()
+{
+  if (Cache.HeaderP->GrpIndexValid == true)
+    return true;
+
+  // keep at most three quarters of the slots used for short probe sequences
+  uint32_t Size = 16;
+  while (Size - Size / 4 <= Cache.HeaderP->GroupCount)
+    Size *= 2;
+
+  if (Cache.HeaderP->GrpIndex == 0 || Cache.HeaderP->GrpIndexSize < Size)
+  {
+    size_t oldSize = Map.Size();
+    void const *const oldMap = Map.Data();
+    _error->PushToStack();
+    auto const Offset = Map.RawAllocate(Size * sizeof(pkgCache::GroupIndexSlot), sizeof(pkgCache::GroupIndexSlot));
+    bool const newError = _error->PendingError();
+    _error->MergeWithStack();
+    if (Offset == 0 && newError)
+      return false;
+    ReMap(oldMap, Map.Data(), oldSize);
+    Cache.HeaderP->GrpIndex = map_pointer<pkgCache::GroupIndexSlot>{NarrowOffset(Offset / sizeof(pkgCache::GroupIndexSlot))};
+    Cache.HeaderP->GrpIndexSize = Size;
+  }
+
+  uint32_t const Mask = Cache.HeaderP->GrpIndexSize - 1;
+  pkgCache::GroupIndexSlot *const Slots = Cache.HeaderP->GrpIndexP();
+  std::fill_n(Slots, Cache.HeaderP->GrpIndexSize, pkgCache::GroupIndexSlot{});
+  for (auto G = Cache.GrpBegin(); G.end() == false; ++G)
+  {
+    pkgCache::GroupIndexSlot Insert{pkgCache::GroupIndexHash(Cache.ViewString(G->Name)), G.MapPointer()};
+    for (uint32_t I = Insert.Hash & Mask, Distance = 0;; I = (I + 1) & Mask, ++Distance)
+    {
+      if (Slots[I].Grp == 0)
+      {
+        Slots[I] = Insert;
+        break;
+      }
+      // Robin Hood: the group further away from its slot takes this one
+      uint32_t const SlotDistance = (I - Slots[I].Hash) & Mask;
+      if (SlotDistance < Distance)
+      {
+        std::swap(Slots[I], Insert);
+        Distance = SlotDistance;
+      }
+    }
+  }
+  Cache.HeaderP->GrpIndexValid = true;
+  return true;
+}
+/*}}}*/
+// CacheGenerator::BuildStringIndex - Index the stored strings		/*{{{*/
+// ---------------------------------------------------------------------
+/* The strings stored since the table was built the last time are added to
+   it, it is only built anew in a larger place if it runs out of room. */
+bool pkgCacheGenerator::BuildStringIndex()
+{
+  size_t const Added = strMixed.size() + strVersions.size() + strSections.size();
+  if (Added == 0)
+    return true;
+
+  uint32_t const Count = Cache.HeaderP->StrIndexCount + Added;
+  uint32_t Size = 16;
+  while (Size - Size / 4 <= Count)
+    Size *= 2;
+
+  std::vector<pkgCache::StringIndexSlot> Kept;
+  if (Cache.HeaderP->StrIndex == 0 || Cache.HeaderP->StrIndexSize < Size)
+  {
+    Kept.reserve(Cache.HeaderP->StrIndexCount);
+    if (Cache.HeaderP->StrIndex != 0)
+      std::copy_if(Cache.HeaderP->StrIndexP(), Cache.HeaderP->StrIndexP() + Cache.HeaderP->StrIndexSize,
+                   std::back_inserter(Kept), [](pkgCache::StringIndexSlot const &Slot) { return Slot.String != 0; });
+
+    size_t oldSize = Map.Size();
+    void const *const oldMap = Map.Data();
+    _error->PushToStack();
+    auto const Offset = Map.RawAllocate(Size * sizeof(pkgCache::StringIndexSlot), sizeof(pkgCache::StringIndexSlot));
+    bool const newError = _error->PendingError();
+    _error->MergeWithStack();
+    if (Offset == 0 && newError)
+      return false;
+    ReMap(oldMap, Map.Data(), oldSize);
+    Cache.HeaderP->StrIndex = map_pointer<pkgCache::StringIndexSlot>{NarrowOffset(Offset / sizeof(pkgCache::StringIndexSlot))};
+    Cache.HeaderP->StrIndexSize = Size;
+    std::fill_n(Cache.HeaderP->StrIndexP(), Size, pkgCache::StringIndexSlot{});
+  }
+
+  uint32_t const Mask = Cache.HeaderP->StrIndexSize - 1;
+  pkgCache::StringIndexSlot *const Slots = Cache.HeaderP->StrIndexP();
+  auto const Insert = [&](pkgCache::StringIndexSlot Item) {
+    for (uint32_t I = Item.Hash & Mask, Distance = 0;; I = (I + 1) & Mask, ++Distance)
+    {
+      if (Slots[I].String == 0)
+      {
+        Slots[I] = Item;
+        break;
+      }
+      uint32_t const SlotDistance = (I - Slots[I].Hash) & Mask;
+      if (SlotDistance < Distance)
+      {
+        std::swap(Slots[I], Item);
+        Distance = SlotDistance;
+      }
+    }
+  };
+  for (auto const &Item : Kept)
+    Insert(Item);
+  for (auto const strings : {&strMixed, &strVersions, &strSections})
+  {
+    for (auto const &String : *strings)
+      Insert({hash{}(String), String.item});
+    // from now on these are found in the index
+    strings->clear();
+  }
+  Cache.HeaderP->StrIndexCount = Count;
   return true;
 }
 /*}}}*/
@@ -857,9 +1016,10 @@ bool pkgCacheGenerator::NewFileVer(pkgCache::VerIterator &Ver,
   pkgCache::VerFileIterator VF(Cache, Cache.VerFileP + VerFile);
   VF->File = map_pointer<pkgCache::PackageFile>{NarrowOffset(CurrentFile - Cache.PkgFileP)};
 
-  // Link it to the end of the list
+  // Link it to the end of the list, but in front of files merged after
+  // this one, which we encounter if an index is merged again (RecycleFiles)
   map_pointer<pkgCache::VerFile> *Last = &Ver->FileList;
-  for (pkgCache::VerFileIterator V = Ver.FileList(); V.end() == false; ++V)
+  for (pkgCache::VerFileIterator V = Ver.FileList(); V.end() == false && V.File()->ID <= CurrentFile->ID; ++V)
     Last = &V->NextFile;
   VF->NextFile = *Last;
   *Last = VF.MapPointer();
@@ -900,10 +1060,6 @@ map_pointer<pkgCache::Version> pkgCacheGenerator::NewVersion(pkgCache::VerIterat
   Ver->Hash = Hash;
   Ver->ID = Cache.HeaderP->VersionCount++;
 
-  // Allocate size for extra store
-  if (VersionExtra.size() <= Ver->ID)
-    VersionExtra.resize(Ver->ID + 1);
-
   // try to find the version string in the group for reuse
   pkgCache::PkgIterator Pkg = Ver.ParentPkg();
   pkgCache::GrpIterator Grp = Pkg.Group();
@@ -1264,14 +1420,14 @@ bool pkgCacheListParser::NewProvidesAllArch(pkgCache::VerIterator &Ver, StringVi
     bool const isArchSpecific = (Flags & pkgCache::Flag::ArchSpecific) == pkgCache::Flag::ArchSpecific;
     pkgCache::PkgIterator OwnerPkg = Ver.ParentPkg();
     Dynamic<pkgCache::PkgIterator> DynOwnerPkg(OwnerPkg);
+    if (isArchSpecific == false && IsKnownArchitecture(OwnerPkg.Arch()) == false)
+      return true;
     pkgCache::PkgIterator Pkg;
     Dynamic<pkgCache::PkgIterator> DynPkg(Pkg);
     for (Pkg = Grp.PackageList(); Pkg.end() == false; Pkg = Grp.NextPkg(Pkg))
     {
       if (isImplicit && OwnerPkg == Pkg)
         continue;
-      if (isArchSpecific == false && APT::Configuration::checkArchitecture(OwnerPkg.Arch()) == false)
-        continue;
       if (Owner->NewProvides(Ver, Pkg, idxProvideVersion, Flags) == false)
         return false;
     }
@@ -1279,12 +1435,48 @@ bool pkgCacheListParser::NewProvidesAllArch(pkgCache::VerIterator &Ver, StringVi
   return true;
 }
 /*}}}*/
+bool pkgCacheListParser::IsKnownArchitecture(StringView const Arch) const /*{{{*/
+{
+  if (Arch == "all")
+    return true;
+  return std::any_of(Architectures.begin(), Architectures.end(), [&](std::string const &A)
+                     { return Arch == A; });
+}
+/*}}}*/
 bool pkgCacheListParser::SameVersion(uint32_t Hash, /*{{{*/
                                      pkgCache::VerIterator const &Ver)
 {
   return Hash == Ver->Hash;
 }
 /*}}}*/
+// TakeRecycledFile - Find a recycled (release) file to be refilled	/*{{{*/
+// ---------------------------------------------------------------------
+/* The entry is cleared except for the fields identifying it and its
+   position in the list of files, so that it looks freshly allocated
+   for the Select*File methods */
+template <typename T>
+static map_pointer<T> TakeRecycledFile(pkgCache &Cache, T *const Files,
+                                       std::vector<map_pointer<T>> &Recycled,
+                                       std::string const &FileName)
+{
+  auto const R = std::find_if(Recycled.begin(), Recycled.end(), [&](map_pointer<T> const F)
+                              { return FileName == Cache.StrP + (Files + F)->FileName; });
+  if (R == Recycled.end())
+    return 0;
+  auto const idxFile = *R;
+  Recycled.erase(R);
+
+  T &File = *(Files + idxFile);
+  auto const idxFileName = File.FileName;
+  auto const NextFile = File.NextFile;
+  auto const ID = File.ID;
+  File = T();
+  File.FileName = idxFileName;
+  File.NextFile = NextFile;
+  File.ID = ID;
+  return idxFile;
+}
+/*}}}*/
 // CacheGenerator::SelectReleaseFile - Select the current release file the indexes belong to	/*{{{*/
 bool pkgCacheGenerator::SelectReleaseFile(const string &File, const string &Site,
                                           unsigned long Flags)
@@ -1293,23 +1485,35 @@ bool pkgCacheGenerator::SelectReleaseFile(const string &File, const string &Site
   if (File.empty() && Site.empty())
     return true;
 
-  // Get some space for the structure
-  auto const idxFile = AllocateInMap<pkgCache::ReleaseFile>();
-  if (unlikely(idxFile == 0))
-    return false;
-  CurrentRlsFile = Cache.RlsFileP + idxFile;
+  auto const idxRecycled = TakeRecycledFile(Cache, Cache.RlsFileP, RecycledRlsFiles, File);
+  if (idxRecycled != 0)
+    CurrentRlsFile = Cache.RlsFileP + idxRecycled;
+  else
+  {
+    // Get some space for the structure
+    auto const idxFile = AllocateInMap<pkgCache::ReleaseFile>();
+    if (unlikely(idxFile == 0))
+      return false;
+    CurrentRlsFile = Cache.RlsFileP + idxFile;
+
+    map_stringitem_t const idxFileName = WriteStringInMap(File);
+    if (unlikely(idxFileName == 0))
+      return false;
+    CurrentRlsFile->FileName = idxFileName;
+  }
 
   // Fill it in
-  map_stringitem_t const idxFileName = WriteStringInMap(File);
   map_stringitem_t const idxSite = StoreString(MIXED, Site);
-  if (unlikely(idxFileName == 0 || idxSite == 0))
+  if (unlikely(idxSite == 0))
     return false;
-  CurrentRlsFile->FileName = idxFileName;
   CurrentRlsFile->Site = idxSite;
-  CurrentRlsFile->NextFile = Cache.HeaderP->RlsFileList;
   CurrentRlsFile->Flags = Flags;
-  CurrentRlsFile->ID = Cache.HeaderP->ReleaseFileCount;
   RlsFileName = File;
+  if (idxRecycled != 0)
+    return true;
+
+  CurrentRlsFile->NextFile = Cache.HeaderP->RlsFileList;
+  CurrentRlsFile->ID = Cache.HeaderP->ReleaseFileCount;
   Cache.HeaderP->RlsFileList = map_pointer<pkgCache::ReleaseFile>{NarrowOffset(CurrentRlsFile - Cache.RlsFileP)};
   Cache.HeaderP->ReleaseFileCount++;
 
@@ -1327,19 +1531,24 @@ bool pkgCacheGenerator::SelectFile(std::string const &File,
                                    unsigned long const Flags)
 {
   CurrentFile = nullptr;
-  // Get some space for the structure
-  auto const idxFile = AllocateInMap<pkgCache::PackageFile>();
-  if (unlikely(idxFile == 0))
-    return false;
-  CurrentFile = Cache.PkgFileP + idxFile;
+  auto const idxRecycled = TakeRecycledFile(Cache, Cache.PkgFileP, RecycledFiles, File);
+  if (idxRecycled != 0)
+    CurrentFile = Cache.PkgFileP + idxRecycled;
+  else
+  {
+    // Get some space for the structure
+    auto const idxFile = AllocateInMap<pkgCache::PackageFile>();
+    if (unlikely(idxFile == 0))
+      return false;
+    CurrentFile = Cache.PkgFileP + idxFile;
+
+    map_stringitem_t const idxFileName = WriteStringInMap(File);
+    if (unlikely(idxFileName == 0))
+      return false;
+    CurrentFile->FileName = idxFileName;
+  }
 
   // Fill it in
-  map_stringitem_t const idxFileName = WriteStringInMap(File);
-  if (unlikely(idxFileName == 0))
-    return false;
-  CurrentFile->FileName = idxFileName;
-  CurrentFile->NextFile = Cache.HeaderP->FileList;
-  CurrentFile->ID = Cache.HeaderP->PackageFileCount;
   map_stringitem_t const idxIndexType = StoreString(MIXED, Index.GetType()->Label);
   if (unlikely(idxIndexType == 0))
     return false;
@@ -1363,14 +1572,237 @@ bool pkgCacheGenerator::SelectFile(std::string const &File,
   else
     CurrentFile->Release = 0;
   PkgFileName = File;
-  Cache.HeaderP->FileList = map_pointer<pkgCache::PackageFile>{NarrowOffset(CurrentFile - Cache.PkgFileP)};
-  Cache.HeaderP->PackageFileCount++;
+  if (idxRecycled == 0)
+  {
+    CurrentFile->NextFile = Cache.HeaderP->FileList;
+    CurrentFile->ID = Cache.HeaderP->PackageFileCount;
+    Cache.HeaderP->FileList = map_pointer<pkgCache::PackageFile>{NarrowOffset(CurrentFile - Cache.PkgFileP)};
+    Cache.HeaderP->PackageFileCount++;
+  }
 
   if (Progress != 0)
     Progress->SubProgress(Index.Size());
   return true;
 }
 /*}}}*/
+// UnlinkFromList - Remove an item from a single linked list in the map	/*{{{*/
+template <typename T>
+static void UnlinkFromList(T *const Items, map_pointer<T> *Link, map_pointer<T> const Item,
+                           map_pointer<T> T::*const Next)
+{
+  for (; *Link != 0; Link = &((Items + *Link)->*Next))
+    if (*Link == Item)
+    {
+      *Link = (Items + Item)->*Next;
+      return;
+    }
+}
+/*}}}*/
+// UnlinkVersion - Remove a version and everything hanging off it	/*{{{*/
+// ---------------------------------------------------------------------
+/* The version itself has to be removed from the version list of its
+   package by the caller. The structures stay in the map as garbage, but
+   are no longer reachable. */
+static void UnlinkVersion(pkgCache &Cache, pkgCache::VerIterator const &Ver)
+{
+  for (pkgCache::DepIterator D = Ver.DependsList(); D.end() == false; ++D)
+    UnlinkFromList(Cache.DepP, &D.TargetPkg()->RevDepends, D.MapPointer(), &pkgCache::Dependency::NextRevDepends);
+  for (pkgCache::PrvIterator Prv = Ver.ProvidesList(); Prv.end() == false; ++Prv)
+    UnlinkFromList(Cache.ProvideP, &Prv.ParentPkg()->ProvidesList, Prv.MapPointer(), &pkgCache::Provides::NextProvides);
+  if (Ver->SourcePkgName != 0)
+  {
+    pkgCache::GrpIterator SrcGrp = Cache.FindGrp(Ver.SourcePkgName());
+    if (SrcGrp.end() == false)
+      UnlinkFromList(Cache.VerP, &SrcGrp->VersionsInSource, Ver.MapPointer(), &pkgCache::Version::NextInSource);
+  }
+}
+/*}}}*/
+// RelinkDependencyData - Chain the DependencyData of a package again	/*{{{*/
+// ---------------------------------------------------------------------
+/* NewDepends finds the DependencyData it can share in a chain sorted by
+   version which starts at the first of the RevDepends of the package.
+   Unlinking dependencies can leave that chain with data no dependency uses
+   anymore or break it, so it is rebuilt from the dependencies left. */
+static map_id_t RelinkDependencyData(pkgCache &Cache, pkgCache::Package *const Pkg,
+                                     std::vector<map_pointer<pkgCache::DependencyData>> &Data)
+{
+  Data.clear();
+  for (auto D = Pkg->RevDepends; D != 0; D = (Cache.DepP + D)->NextRevDepends)
+    Data.push_back((Cache.DepP + D)->DependencyData);
+  if (Data.empty() == true)
+    return 0;
+  std::sort(Data.begin(), Data.end());
+  Data.erase(std::unique(Data.begin(), Data.end()), Data.end());
+  std::stable_sort(Data.begin(), Data.end(), [&](map_pointer<pkgCache::DependencyData> const A, map_pointer<pkgCache::DependencyData> const B)
+                   { return (Cache.DepDataP + A)->Version > (Cache.DepDataP + B)->Version; });
+  for (size_t I = 0; I + 1 < Data.size(); ++I)
+    (Cache.DepDataP + Data[I])->NextData = Data[I + 1];
+  (Cache.DepDataP + Data.back())->NextData = 0;
+
+  // move a dependency using the head of the chain to the front
+  map_pointer<pkgCache::Dependency> *Link = &Pkg->RevDepends;
+  while ((Cache.DepP + *Link)->DependencyData != Data.front())
+    Link = &(Cache.DepP + *Link)->NextRevDepends;
+  if (Link != &Pkg->RevDepends)
+  {
+    auto const First = *Link;
+    *Link = (Cache.DepP + First)->NextRevDepends;
+    (Cache.DepP + First)->NextRevDepends = Pkg->RevDepends;
+    Pkg->RevDepends = First;
+  }
+  return Data.size();
+}
+/*}}}*/
+// RenumberCache - Give the structures still linked dense IDs again	/*{{{*/
+// ---------------------------------------------------------------------
+/* The IDs index arrays sized by the counts in the header, so the gaps
+   unlinking structures left are closed and the counts in the header are
+   those of the structures still in use again. As the counts were those of
+   all structures allocated so far, the difference is garbage now. The
+   strings of the unlinked structures are not accounted for as they can
+   be shared with others. */
+static void RenumberCache(pkgCache &Cache)
+{
+  pkgCache::Header &Head = *Cache.HeaderP;
+  map_id_t Versions = 0;
+  map_id_t Depends = 0;
+  map_id_t DependsData = 0;
+  map_id_t Provides = 0;
+  std::vector<bool> SeenDesc(Head.DescriptionCount, false);
+  std::vector<pkgCache::Description *> Descs;
+  std::vector<map_pointer<pkgCache::DependencyData>> Data;
+  for (pkgCache::PkgIterator P = Cache.PkgBegin(); P.end() == false; ++P)
+  {
+    pkgCache::Package *const Pkg = P;
+    DependsData += RelinkDependencyData(Cache, Pkg, Data);
+    for (auto V = Pkg->VersionList; V != 0; V = (Cache.VerP + V)->NextVer)
+    {
+      pkgCache::Version *const Ver = Cache.VerP + V;
+      Ver->ID = Versions++;
+      for (auto D = Ver->DependsList; D != 0; D = (Cache.DepP + D)->NextDepends)
+        (Cache.DepP + D)->ID = Depends++;
+      for (auto Prv = Ver->ProvidesList; Prv != 0; Prv = (Cache.ProvideP + Prv)->NextPkgProv)
+        ++Provides;
+      for (auto D = Ver->DescriptionList; D != 0; D = (Cache.DescP + D)->NextDesc)
+        if (SeenDesc[(Cache.DescP + D)->ID] == false)
+        {
+          SeenDesc[(Cache.DescP + D)->ID] = true;
+          Descs.push_back(Cache.DescP + D);
+        }
+    }
+  }
+  for (size_t I = 0; I < Descs.size(); ++I)
+    Descs[I]->ID = I;
+
+  Head.GarbageSize += (Head.VersionCount - Versions) * (sizeof(pkgCache::Version) + sizeof(pkgCache::Version::Extra)) +
+                      (Head.DescriptionCount - Descs.size()) * sizeof(pkgCache::Description) +
+                      (Head.DependsCount - Depends) * sizeof(pkgCache::Dependency) +
+                      (Head.DependsDataCount - DependsData) * sizeof(pkgCache::DependencyData) +
+                      (Head.ProvidesCount - Provides) * sizeof(pkgCache::Provides);
+  Head.VersionCount = Versions;
+  Head.DescriptionCount = Descs.size();
+  Head.DependsCount = Depends;
+  Head.DependsDataCount = DependsData;
+  Head.ProvidesCount = Provides;
+}
+/*}}}*/
+// CacheGenerator::RecycleFiles - Remove everything a file contributed	/*{{{*/
+void pkgCacheGenerator::RecycleFiles(std::vector<pkgCache::PkgFileIterator> const &Files)
+{
+  std::vector<bool> Recycle(Cache.HeaderP->PackageFileCount, false);
+  for (auto const &File : Files)
+  {
+    Recycle[File->ID] = true;
+    RecycledFiles.push_back(File.MapPointer());
+  }
+
+  // descriptions are shared between versions, so remember which we emptied
+  std::vector<bool> Emptied(Cache.HeaderP->DescriptionCount, false);
+  std::vector<pkgCache::PkgIterator> Abandoned;
+  for (pkgCache::PkgIterator Pkg = Cache.PkgBegin(); Pkg.end() == false; ++Pkg)
+  {
+    if (Pkg->VersionList == 0)
+      continue;
+
+    map_pointer<pkgCache::Version> *LastVer = &Pkg->VersionList;
+    for (pkgCache::VerIterator Ver = Pkg.VersionList(); Ver.end() == false; ++Ver)
+    {
+      bool Dropped = false;
+      map_pointer<pkgCache::VerFile> *LastVF = &Ver->FileList;
+      for (pkgCache::VerFileIterator VF = Ver.FileList(); VF.end() == false; ++VF)
+      {
+        if (Recycle[VF.File()->ID] == false)
+        {
+          LastVF = &VF->NextFile;
+          continue;
+        }
+        *LastVF = VF->NextFile;
+        --Cache.HeaderP->VerFileCount;
+        Cache.HeaderP->GarbageSize += sizeof(pkgCache::VerFile);
+        Dropped = true;
+      }
+
+      map_pointer<pkgCache::Description> *LastDesc = &Ver->DescriptionList;
+      for (pkgCache::DescIterator Desc = Ver.DescriptionList(); Desc.end() == false; ++Desc)
+      {
+        map_pointer<pkgCache::DescFile> *LastDF = &Desc->FileList;
+        for (pkgCache::DescFileIterator DF = Desc.FileList(); DF.end() == false; ++DF)
+        {
+          if (Recycle[DF.File()->ID] == false)
+          {
+            LastDF = &DF->NextFile;
+            continue;
+          }
+          *LastDF = DF->NextFile;
+          --Cache.HeaderP->DescFileCount;
+          Cache.HeaderP->GarbageSize += sizeof(pkgCache::DescFile);
+          Emptied[Desc->ID] = true;
+        }
+        if (Emptied[Desc->ID] == true && Desc->FileList == 0)
+          *LastDesc = Desc->NextDesc;
+        else
+          LastDesc = &Desc->NextDesc;
+      }
+
+      if (Dropped == false || Ver->FileList != 0 || Pkg.CurrentVer() == Ver)
+      {
+        LastVer = &Ver->NextVer;
+        continue;
+      }
+      *LastVer = Ver->NextVer;
+      UnlinkVersion(Cache, Ver);
+    }
+    if (Pkg->VersionList == 0)
+      Abandoned.push_back(Pkg);
+  }
+
+  /* The implicit multi-arch dependencies on a package are created with its
+     first version, so we have to remove them if it has none left */
+  for (auto &Pkg : Abandoned)
+  {
+    map_pointer<pkgCache::Dependency> *Link = &Pkg->RevDepends;
+    while (*Link != 0)
+    {
+      pkgCache::DepIterator D(Cache, Cache.DepP + *Link);
+      if ((D->CompareOp & pkgCache::Dep::MultiArchImplicit) == 0 || D.ParentPkg()->Group != Pkg->Group)
+      {
+        Link = &(Cache.DepP + *Link)->NextRevDepends;
+        continue;
+      }
+      *Link = D->NextRevDepends;
+      UnlinkFromList(Cache.DepP, &D.ParentVer()->DependsList, D.MapPointer(), &pkgCache::Dependency::NextDepends);
+    }
+  }
+
+  RenumberCache(Cache);
+}
+/*}}}*/
+// CacheGenerator::RecycleReleaseFile - Refill a release file in place	/*{{{*/
+void pkgCacheGenerator::RecycleReleaseFile(pkgCache::RlsFileIterator const &File)
+{
+  RecycledRlsFiles.push_back(File.MapPointer());
+}
+/*}}}*/
 // CacheGenerator::WriteUniqueString - Insert a unique string		/*{{{*/
 // ---------------------------------------------------------------------
 /* This is used to create handles to strings. Given the same text it
@@ -1399,11 +1831,49 @@ map_stringitem_t pkgCacheGenerator::StoreString(enum StringType const type, cons
   if (item != strings->end())
     return item->item;
 
+  // the strings stored by earlier runs are in the index written with them
+  if (Cache.HeaderP->StrIndexCount != 0)
+  {
+    pkgCache::StringIndexSlot const *const Slots = Cache.HeaderP->StrIndexP();
+    uint32_t const Mask = Cache.HeaderP->StrIndexSize - 1;
+    uint32_t const Hash = hash{}({S, Size, nullptr, 0});
+    for (uint32_t I = Hash & Mask, Distance = 0;; I = (I + 1) & Mask, ++Distance)
+    {
+      pkgCache::StringIndexSlot const &Slot = Slots[I];
+      if (Slot.String == 0 || ((I - Slot.Hash) & Mask) < Distance)
+        break;
+      if (Slot.Hash == Hash && Cache.ViewString(Slot.String) == StringView(S, Size))
+        return Slot.String;
+    }
+  }
+
   map_stringitem_t const idxString = WriteStringInMap(S, Size);
   strings->insert({nullptr, Size, this, idxString});
   return idxString;
 }
 /*}}}*/
+// CacheGenerator::RememberCacheSize - Hint the size of the next cache	/*{{{*/
+void pkgCacheGenerator::RememberCacheSize(FileFd &CacheFile)
+{
+  if (CacheFile.IsOpen() == false || _config->Exists("APT::Cache-Start::IndexSize"))
+    return;
+
+  pkgCache::Header Expected;
+  pkgCache::Header Header;
+  auto const CacheSize = CacheFile.FileSize();
+  _error->PushToStack();
+  bool const Read = CacheFile.Seek(0) && CacheFile.Read(&Header, sizeof(Header));
+  _error->RevertToStack();
+  if (Read == false || Header.Signature != Expected.Signature ||
+      Header.MajorVersion != Expected.MajorVersion || Header.CheckSizes(Expected) == false ||
+      Header.IndexSize == 0 || CacheSize > static_cast<unsigned long long>(std::numeric_limits<int>::max()) ||
+      Header.IndexSize > static_cast<unsigned long long>(std::numeric_limits<int>::max()))
+    return;
+
+  _config->Set("APT::Cache-Start::CacheSize", static_cast<int>(CacheSize));
+  _config->Set("APT::Cache-Start::IndexSize", static_cast<int>(Header.IndexSize));
+}
+/*}}}*/
 // CheckValidity - Check that a cache is up-to-date			/*{{{*/
 // ---------------------------------------------------------------------
 /* This just verifies that each file in the list of index files exists,
@@ -1443,6 +1913,7 @@ static bool CheckValidity(FileFd &CacheFile, std::string const &CacheFileName,
     if (std::numeric_limits<int>::max() >= size && size > APT_CACHE_START_DEFAULT)
       _config->Set("APT::Cache-Start", size);
   }
+  pkgCacheGenerator::RememberCacheSize(CacheFile);
 
   if (List.GetLastModifiedTime() > CacheFile.ModificationTime())
   {
@@ -1579,6 +2050,205 @@ static map_filesize_t ComputeSize(pkgSourceList const *const List, FileIterator
   return TotalSize;
 }
 /*}}}*/
+// CacheGenerator::IndexPreloader - Read index files in other threads	/*{{{*/
+// ---------------------------------------------------------------------
+/* Merging an index changes the map with every stanza, so this has to
+   happen serially, but opening, decompressing and reading the index files
+   is independent of the cache. Worker threads do this for the next few
+   indexes while the current one is merged, so the merge only has to parse
+   the in-memory buffers. How far they may get ahead is limited by the size
+   of the buffers waiting for the merge, not by their number, as a Packages
+   file can be a thousand times bigger than another. The merge order is
+   unchanged, so the resulting cache is the same as the one built without
+   preloading. */
+class APT_HIDDEN pkgCacheGenerator::IndexPreloader
+{
+  struct Job
+  {
+    pkgDebianIndexFile *const Index;
+    enum
+    {
+      WAITING,
+      LOADING,
+      LOADED,
+      SKIPPED,
+    } State;
+    std::unique_ptr<FileFd> Pkg;
+    std::unique_ptr<pkgCacheListParser> Parser;
+    // bytes loaded into the parser
+    unsigned long long Size = 0;
+
+    explicit Job(pkgDebianIndexFile *const Index) : Index(Index), State(WAITING) {}
+  };
+  pkgCacheGenerator &Gen;
+  std::vector<Job> Jobs;
+  // the next job to be picked up by a worker
+  size_t NextJob;
+  // jobs before this one were taken by the merge or skipped by it
+  size_t Cursor;
+  // bytes loaded ahead of the merge and how many that may be
+  unsigned long long Ahead;
+  unsigned long long const Limit;
+  bool Stopped;
+  std::mutex Lock;
+  std::condition_variable Changed;
+  std::vector<std::thread> Workers;
+
+  void Work();
+
+  public:
+  bool Take(pkgIndexFile const *Index, std::unique_ptr<FileFd> &Pkg,
+            std::unique_ptr<pkgCacheListParser> &Parser);
+
+  IndexPreloader(pkgCacheGenerator &Gen, std::vector<pkgDebianIndexFile *> const &Indexes, unsigned int const Threads,
+                 unsigned long long const Limit);
+  ~IndexPreloader();
+};
+pkgCacheGenerator::IndexPreloader::IndexPreloader(pkgCacheGenerator &Gen,
+                                                  std::vector<pkgDebianIndexFile *> const &Indexes,
+                                                  unsigned int const Threads,
+                                                  unsigned long long const Limit)
+    : Gen(Gen), NextJob(0), Cursor(0), Ahead(0), Limit(Limit), Stopped(false)
+{
+  Jobs.reserve(Indexes.size());
+  for (auto const I : Indexes)
+    Jobs.emplace_back(I);
+
+  // fill the static caches used while opening files and creating the
+  // parsers before threads race for them
+  APT::Configuration::getCompressors();
+  APT::Configuration::getLanguages(true);
+
+  for (unsigned int i = 0; i < Threads && i < Jobs.size(); ++i)
+  {
+    try
+    {
+      Workers.emplace_back(&IndexPreloader::Work, this);
+    }
+    catch (std::system_error const &)
+    {
+      // jobs not picked up by a worker are done by the merge itself
+      break;
+    }
+  }
+  Gen.Preloader = this;
+}
+pkgCacheGenerator::IndexPreloader::~IndexPreloader()
+{
+  Gen.Preloader = nullptr;
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    Stopped = true;
+  }
+  Changed.notify_all();
+  for (auto &W : Workers)
+    W.join();
+}
+void pkgCacheGenerator::IndexPreloader::Work()
+{
+  std::unique_lock<std::mutex> Guard(Lock);
+  while (true)
+  {
+    Changed.wait(Guard, [&]
+                 { return Stopped || NextJob >= Jobs.size() || NextJob <= Cursor || Ahead < Limit; });
+    if (Stopped || NextJob >= Jobs.size())
+      return;
+    Job &J = Jobs[NextJob++];
+    if (J.State != Job::WAITING)
+      continue;
+    J.State = Job::LOADING;
+    Guard.unlock();
+
+    std::unique_ptr<FileFd> Pkg;
+    std::unique_ptr<pkgCacheListParser> Parser;
+    bool Okay = J.Index->OpenListParser(Pkg, Parser) && Parser != nullptr;
+    if (Okay)
+    {
+      auto const DebList = dynamic_cast<debListParser *>(Parser.get());
+      Okay = DebList != nullptr && DebList->Preload();
+    }
+    // at the end of the file, this is the size of the buffer
+    unsigned long long const Size = Okay && Pkg->IsOpen() ? Pkg->Tell() : 0;
+    // messages are generated again by the merge redoing the work, as
+    // _error is thread-local and hence would be lost for the user here
+    if (_error->empty(GlobalError::DEBUG) == false)
+    {
+      Okay = false;
+      _error->Discard();
+    }
+
+    Guard.lock();
+    if (J.State == Job::LOADING)
+    {
+      if (Okay)
+      {
+        J.Pkg = std::move(Pkg);
+        J.Parser = std::move(Parser);
+        J.Size = Size;
+        Ahead += Size;
+      }
+      J.State = Job::LOADED;
+    }
+    Changed.notify_all();
+  }
+}
+bool pkgCacheGenerator::IndexPreloader::Take(pkgIndexFile const *Index, std::unique_ptr<FileFd> &Pkg,
+                                             std::unique_ptr<pkgCacheListParser> &Parser)
+{
+  std::unique_lock<std::mutex> Guard(Lock);
+  auto const J = std::find_if(Jobs.begin() + Cursor, Jobs.end(), [&](Job const &J)
+                              { return J.Index == Index; });
+  if (J == Jobs.end())
+    return false;
+
+  // the merge skipped these (e.g. as duplicates), so drop them early
+  for (auto S = Jobs.begin() + Cursor; S != J; ++S)
+  {
+    S->State = Job::SKIPPED;
+    S->Parser.reset();
+    S->Pkg.reset();
+    Ahead -= S->Size;
+    S->Size = 0;
+  }
+  Cursor = std::distance(Jobs.begin(), J) + 1;
+  Changed.notify_all();
+
+  if (J->State == Job::WAITING)
+  {
+    J->State = Job::SKIPPED;
+    return false;
+  }
+  Changed.wait(Guard, [&]
+               { return J->State == Job::LOADED; });
+  J->State = Job::SKIPPED;
+  Pkg = std::move(J->Pkg);
+  Parser = std::move(J->Parser);
+  Ahead -= J->Size;
+  J->Size = 0;
+  Changed.notify_all();
+  return Parser != nullptr;
+}
+/*}}}*/
+bool pkgCacheGenerator::TakePreloadedIndex(pkgIndexFile const *Index, std::unique_ptr<FileFd> &Pkg, /*{{{*/
+                                           std::unique_ptr<pkgCacheListParser> &Parser)
+{
+  return Preloader != nullptr && Preloader->Take(Index, Pkg, Parser);
+}
+/*}}}*/
+// StartPreloader - Read the given indexes ahead if it is worth it	/*{{{*/
+static std::unique_ptr<pkgCacheGenerator::IndexPreloader> StartPreloader(pkgCacheGenerator &Gen,
+                                                                         std::vector<pkgDebianIndexFile *> const &Indexes)
+{
+  int const Threads = _config->FindI("APT::Cache-Threads", std::thread::hardware_concurrency());
+  if (Threads <= 1 || Indexes.size() <= 1)
+    return nullptr;
+  unsigned long long const Limit = std::max(0, _config->FindI("APT::Cache-Preload-Limit", 128 * 1024 * 1024));
+  if (_config->FindB("Debug::pkgCacheGen", false))
+    std::clog << "Preloading " << Indexes.size() << " index files with " << Threads << " threads and up to "
+              << Limit << " bytes" << std::endl;
+  return std::unique_ptr<pkgCacheGenerator::IndexPreloader>(new pkgCacheGenerator::IndexPreloader(Gen, Indexes, Threads, Limit));
+}
+/*}}}*/
 // BuildCache - Merge the list of index files into the cache		/*{{{*/
 static bool BuildCache(pkgCacheGenerator &Gen,
                        OpProgress *const Progress,
@@ -1588,6 +2258,24 @@ static bool BuildCache(pkgCacheGenerator &Gen,
 {
   bool mergeFailure = false;
 
+  // index files from sources.list can be read ahead while merging
+  std::vector<pkgDebianIndexFile *> Preloadable;
+  auto const addPreloadable = [&](pkgIndexFile *const I)
+  {
+    auto const Target = dynamic_cast<pkgDebianIndexTargetFile *>(I);
+    if (Target != nullptr && Target->HasPackages() && Target->Exists())
+      Preloadable.push_back(Target);
+  };
+  if (List != NULL)
+    for (pkgSourceList::const_iterator i = List->begin(); i != List->end(); ++i)
+    {
+      std::vector<pkgIndexFile *> *Indexes = (*i)->GetIndexFiles();
+      if (Indexes != NULL)
+        std::for_each(Indexes->begin(), Indexes->end(), addPreloadable);
+    }
+  std::for_each(Start, End, addPreloadable);
+  auto const Preloader = StartPreloader(Gen, Preloadable);
+
   auto const indexFileMerge = [&](pkgIndexFile *const I)
   {
     if (I->HasPackages() == false || mergeFailure)
@@ -1610,6 +2298,8 @@ static bool BuildCache(pkgCacheGenerator &Gen,
 
     if (I->Merge(Gen, Progress) == false)
       mergeFailure = true;
+    else
+      Gen.GetCache().HeaderP->IndexSize += Size;
   };
 
   if (List != NULL)
@@ -1652,19 +2342,299 @@ static bool BuildCache(pkgCacheGenerator &Gen,
    the cache will be stored there. This is pretty much mandatory if you
    are using AllowMem. AllowMem lets the function be run as non-root
    where it builds the cache 'fast' into a memory buffer. */
-static DynamicMMap *CreateDynamicMMap(FileFd *const CacheF, unsigned long Flags)
+static DynamicMMap *CreateDynamicMMap(FileFd *const CacheF, unsigned long Flags, map_filesize_t Reserve = 0)
 {
-  map_filesize_t const MapStart = _config->FindI("APT::Cache-Start", APT_CACHE_START_DEFAULT);
+  map_filesize_t MapStart = _config->FindI("APT::Cache-Start", APT_CACHE_START_DEFAULT);
   map_filesize_t const MapGrow = _config->FindI("APT::Cache-Grow", 1 * 1024 * 1024);
   map_filesize_t const MapLimit = _config->FindI("APT::Cache-Limit", 0);
+  if (MapLimit != 0 && Reserve > MapLimit)
+    Reserve = MapLimit;
+  if (Reserve > MapStart)
+    MapStart = Reserve;
   Flags |= MMap::Moveable;
   if (_config->FindB("APT::Cache-Fallback", false) == true)
     Flags |= MMap::Fallback;
+  if (_config->FindB("APT::Cache-HugePages", true) == true)
+    Flags |= MMap::HugePages;
   if (CacheF != NULL)
     return new DynamicMMap(*CacheF, Flags, MapStart, MapGrow, MapLimit);
   else
     return new DynamicMMap(Flags, MapStart, MapGrow, MapLimit);
 }
+// PredictCacheSize - Guess how large the cache is going to be		/*{{{*/
+/* The cache remembered by RememberCacheSize was built from a certain amount
+   of index files, so a cache built now will be about as large relative to
+   its index files. Reserving that much for the map right away spares us
+   growing it (and remapping everything pointing into it) over and over. */
+static map_filesize_t PredictCacheSize(map_filesize_t const CacheSize, map_filesize_t const IndexSize)
+{
+  unsigned long long const LastCacheSize = std::max(0, _config->FindI("APT::Cache-Start::CacheSize", 0));
+  unsigned long long const LastIndexSize = std::max(0, _config->FindI("APT::Cache-Start::IndexSize", 0));
+  if (LastCacheSize == 0 || LastIndexSize == 0)
+    return CacheSize;
+
+  unsigned long long Size = LastCacheSize * IndexSize / LastIndexSize;
+  // leave some room as the index files are not all alike
+  Size += CacheSize + Size / 16;
+  return std::min<unsigned long long>(Size, std::numeric_limits<map_filesize_t>::max());
+}
+/*}}}*/
+// ReorderCache - Move the structures of installed packages to the front	/*{{{*/
+// ---------------------------------------------------------------------
+/* The generator allocates the structures in the order the index files are
+   parsed in, so looking at one package touches pages all over the cache.
+   Each kind of structure is reordered within the slots it already occupies,
+   so nothing has to be allocated and strings stay where they are: groups
+   with installed packages come first and packages follow the order of their
+   groups. The installed versions and everything hanging off them come before
+   all other versions. All pointers to the moved structures are rewritten;
+   if one points to a structure which isn't reachable from the groups the
+   cache is left as it is. */
+template <typename T>
+class APT_HIDDEN CacheRelocation
+{
+  // one bit for each position a structure could be at
+  std::vector<uint64_t> Seen;
+  // the number of structures seen in the words of Seen before this one
+  std::vector<uint32_t> SeenBefore;
+  // the old positions sorted, which are the slots the structures move into
+  std::vector<uint32_t> Slots;
+  // the new rank of a structure by the rank of its old position
+  std::vector<uint32_t> Ranks;
+
+  bool IsSeen(uint32_t const Index) const
+  {
+    return (Seen[Index / 64] & (uint64_t{1} << (Index % 64))) != 0;
+  }
+  uint32_t Rank(uint32_t const Index) const
+  {
+    uint64_t const Below = (uint64_t{1} << (Index % 64)) - 1;
+    return SeenBefore[Index / 64] + std::bitset<64>(Seen[Index / 64] & Below).count();
+  }
+
+  public:
+  // the old positions in the new order
+  std::vector<uint32_t> Order;
+
+  bool Add(map_pointer<T> Item)
+  {
+    uint32_t const Index = static_cast<uint32_t>(Item);
+    if (Index == 0 || Index / 64 >= Seen.size() || IsSeen(Index) == true)
+      return false;
+    Seen[Index / 64] |= uint64_t{1} << (Index % 64);
+    Order.push_back(Index);
+    return true;
+  }
+  void Finish()
+  {
+    SeenBefore.resize(Seen.size());
+    Slots.reserve(Order.size());
+    for (size_t Word = 0; Word < Seen.size(); ++Word)
+    {
+      SeenBefore[Word] = Slots.size();
+      for (uint32_t Bit = 0; Bit < 64; ++Bit)
+        if ((Seen[Word] & (uint64_t{1} << Bit)) != 0)
+          Slots.push_back(Word * 64 + Bit);
+    }
+    Ranks.resize(Order.size());
+    for (uint32_t R = 0; R < Order.size(); ++R)
+      Ranks[Rank(Order[R])] = R;
+  }
+  bool Translate(map_pointer<T> &Item) const
+  {
+    uint32_t const Index = static_cast<uint32_t>(Item);
+    if (Index == 0)
+      return true;
+    if (Index / 64 >= Seen.size() || IsSeen(Index) == false)
+      return false;
+    Item = map_pointer<T>{Slots[Ranks[Rank(Index)]]};
+    return true;
+  }
+  /* copies the structures in their new order, so that all of them can be
+     translated before any is overwritten */
+  template <typename Fix>
+  bool Collect(T const *const Base, std::vector<T> &Items, Fix const &Translate) const
+  {
+    Items.reserve(Order.size());
+    for (auto const Index : Order)
+    {
+      Items.push_back(Base[Index]);
+      if (Translate(Items.back()) == false)
+        return false;
+    }
+    return true;
+  }
+  void Store(T *const Base, std::vector<T> const &Items) const
+  {
+    for (size_t R = 0; R < Items.size(); ++R)
+      Base[Slots[R]] = Items[R];
+  }
+
+  explicit CacheRelocation(size_t const MapSize) : Seen(MapSize / sizeof(T) / 64 + 1, 0) {}
+};
+static bool ReorderCache(pkgCache &Cache)
+{
+  size_t const MapSize = Cache.GetMap().Size();
+  CacheRelocation<pkgCache::Group> Grps(MapSize);
+  CacheRelocation<pkgCache::Package> Pkgs(MapSize);
+  CacheRelocation<pkgCache::Version> Vers(MapSize);
+  CacheRelocation<pkgCache::VerFile> VerFiles(MapSize);
+  CacheRelocation<pkgCache::Description> Descs(MapSize);
+  CacheRelocation<pkgCache::DescFile> DescFiles(MapSize);
+  CacheRelocation<pkgCache::Dependency> Deps(MapSize);
+  CacheRelocation<pkgCache::DependencyData> DepData(MapSize);
+  CacheRelocation<pkgCache::Provides> Prvs(MapSize);
+
+  std::vector<map_pointer<pkgCache::Group>> Cold;
+  for (pkgCache::GrpIterator G = Cache.GrpBegin(); G.end() == false; ++G)
+  {
+    bool Installed = false;
+    for (pkgCache::PkgIterator P = G.PackageList(); P.end() == false && Installed == false; P = G.NextPkg(P))
+      Installed = P->CurrentVer != 0;
+    if (Installed == true)
+      Grps.Add(G.MapPointer());
+    else
+      Cold.push_back(G.MapPointer());
+  }
+  for (auto const G : Cold)
+    Grps.Add(G);
+
+  for (auto const G : Grps.Order)
+  {
+    pkgCache::GrpIterator const Grp(Cache, Cache.GrpP + G);
+    for (pkgCache::PkgIterator P = Grp.PackageList(); P.end() == false; P = Grp.NextPkg(P))
+      Pkgs.Add(P.MapPointer());
+  }
+  auto const AddVersion = [&](map_pointer<pkgCache::Version> const V) {
+    if (Vers.Add(V) == false)
+      return;
+    pkgCache::Version const *const Ver = Cache.VerP + V;
+    for (auto F = Ver->FileList; F != 0; F = (Cache.VerFileP + F)->NextFile)
+      VerFiles.Add(F);
+    for (auto D = Ver->DescriptionList; D != 0; D = (Cache.DescP + D)->NextDesc)
+      if (Descs.Add(D) == true)
+        for (auto F = (Cache.DescP + D)->FileList; F != 0; F = (Cache.DescFileP + F)->NextFile)
+          DescFiles.Add(F);
+    for (auto D = Ver->DependsList; D != 0; D = (Cache.DepP + D)->NextDepends)
+    {
+      Deps.Add(D);
+      for (auto DD = (Cache.DepP + D)->DependencyData; DD != 0 && DepData.Add(DD) == true; DD = (Cache.DepDataP + DD)->NextData)
+        ;
+    }
+    for (auto Prv = Ver->ProvidesList; Prv != 0; Prv = (Cache.ProvideP + Prv)->NextPkgProv)
+      Prvs.Add(Prv);
+  };
+  // the installed versions with all they refer to first, then the rest
+  for (auto const P : Pkgs.Order)
+    AddVersion((Cache.PkgP + P)->CurrentVer);
+  for (auto const P : Pkgs.Order)
+    for (auto V = (Cache.PkgP + P)->VersionList; V != 0; V = (Cache.VerP + V)->NextVer)
+      AddVersion(V);
+
+  Grps.Finish();
+  Pkgs.Finish();
+  Vers.Finish();
+  VerFiles.Finish();
+  Descs.Finish();
+  DescFiles.Finish();
+  Deps.Finish();
+  DepData.Finish();
+  Prvs.Finish();
+
+  std::vector<pkgCache::Group> NewGrps;
+  std::vector<pkgCache::Package> NewPkgs;
+  std::vector<pkgCache::Version> NewVers;
+  std::vector<pkgCache::VerFile> NewVerFiles;
+  std::vector<pkgCache::Description> NewDescs;
+  std::vector<pkgCache::DescFile> NewDescFiles;
+  std::vector<pkgCache::Dependency> NewDeps;
+  std::vector<pkgCache::DependencyData> NewDepData;
+  std::vector<pkgCache::Provides> NewPrvs;
+  uint32_t const HashTableSize = Cache.HeaderP->GetHashTableSize();
+  std::vector<map_pointer<pkgCache::Group>> GrpHashTable(Cache.HeaderP->GrpHashTableP(), Cache.HeaderP->GrpHashTableP() + HashTableSize);
+  std::vector<map_pointer<pkgCache::Package>> PkgHashTable(Cache.HeaderP->PkgHashTableP(), Cache.HeaderP->PkgHashTableP() + HashTableSize);
+
+  bool const Translated =
+     std::all_of(GrpHashTable.begin(), GrpHashTable.end(), [&](map_pointer<pkgCache::Group> &G) { return Grps.Translate(G); }) &&
+     std::all_of(PkgHashTable.begin(), PkgHashTable.end(), [&](map_pointer<pkgCache::Package> &P) { return Pkgs.Translate(P); }) &&
+     Grps.Collect(Cache.GrpP, NewGrps, [&](pkgCache::Group &G) {
+       return Pkgs.Translate(G.FirstPackage) && Pkgs.Translate(G.LastPackage) &&
+              Grps.Translate(G.Next) && Vers.Translate(G.VersionsInSource);
+     }) &&
+     Pkgs.Collect(Cache.PkgP, NewPkgs, [&](pkgCache::Package &P) {
+       return Vers.Translate(P.VersionList) && Vers.Translate(P.CurrentVer) &&
+              Grps.Translate(P.Group) && Pkgs.Translate(P.NextPackage) &&
+              Deps.Translate(P.RevDepends) && Prvs.Translate(P.ProvidesList);
+     }) &&
+     Vers.Collect(Cache.VerP, NewVers, [&](pkgCache::Version &V) {
+       return VerFiles.Translate(V.FileList) && Vers.Translate(V.NextVer) &&
+              Descs.Translate(V.DescriptionList) && Deps.Translate(V.DependsList) &&
+              Pkgs.Translate(V.ParentPkg) && Prvs.Translate(V.ProvidesList) &&
+              Vers.Translate(V.NextInSource);
+     }) &&
+     VerFiles.Collect(Cache.VerFileP, NewVerFiles, [&](pkgCache::VerFile &F) {
+       return VerFiles.Translate(F.NextFile);
+     }) &&
+     Descs.Collect(Cache.DescP, NewDescs, [&](pkgCache::Description &D) {
+       return DescFiles.Translate(D.FileList) && Descs.Translate(D.NextDesc) &&
+              Pkgs.Translate(D.ParentPkg);
+     }) &&
+     DescFiles.Collect(Cache.DescFileP, NewDescFiles, [&](pkgCache::DescFile &F) {
+       return DescFiles.Translate(F.NextFile);
+     }) &&
+     Deps.Collect(Cache.DepP, NewDeps, [&](pkgCache::Dependency &D) {
+       return DepData.Translate(D.DependencyData) && Vers.Translate(D.ParentVer) &&
+              Deps.Translate(D.NextRevDepends) && Deps.Translate(D.NextDepends);
+     }) &&
+     DepData.Collect(Cache.DepDataP, NewDepData, [&](pkgCache::DependencyData &D) {
+       return Pkgs.Translate(D.Package) && DepData.Translate(D.NextData);
+     }) &&
+     Prvs.Collect(Cache.ProvideP, NewPrvs, [&](pkgCache::Provides &P) {
+       return Pkgs.Translate(P.ParentPkg) && Vers.Translate(P.Version) &&
+              Prvs.Translate(P.NextProvides) && Prvs.Translate(P.NextPkgProv);
+     });
+  if (Translated == false)
+  {
+    if (_config->FindB("Debug::pkgCacheGen", false))
+      std::clog << "Cache not reordered as it has unreachable structures" << std::endl;
+    return false;
+  }
+
+  std::copy(GrpHashTable.begin(), GrpHashTable.end(), Cache.HeaderP->GrpHashTableP());
+  std::copy(PkgHashTable.begin(), PkgHashTable.end(), Cache.HeaderP->PkgHashTableP());
+  Grps.Store(Cache.GrpP, NewGrps);
+  Pkgs.Store(Cache.PkgP, NewPkgs);
+  Vers.Store(Cache.VerP, NewVers);
+  VerFiles.Store(Cache.VerFileP, NewVerFiles);
+  Descs.Store(Cache.DescP, NewDescs);
+  DescFiles.Store(Cache.DescFileP, NewDescFiles);
+  Deps.Store(Cache.DepP, NewDeps);
+  DepData.Store(Cache.DepDataP, NewDepData);
+  Prvs.Store(Cache.ProvideP, NewPrvs);
+  Cache.HeaderP->GrpIndexValid = false;
+  return true;
+}
+/*}}}*/
+// PruneFragments - Remove the fragments of indexes not in the cache	/*{{{*/
+// ---------------------------------------------------------------------
+/* Fragments are named after the index they were written for, so those of
+   indexes which are no longer merged would be kept around forever. */
+static void PruneFragments(pkgCache &Cache)
+{
+  std::string const FragmentDir = _config->FindDir("Dir::Cache::fragments");
+  if (DirectoryExists(FragmentDir) == false)
+    return;
+
+  std::unordered_set<std::string> Keep;
+  for (pkgCache::PkgFileIterator F = Cache.FileBegin(); F.end() == false; ++F)
+    if (F.FileName() != nullptr)
+      Keep.insert(flNotDir(debFragmentListParser::FragmentFile(F.FileName())));
+
+  for (auto const &File : GetListOfFilesInDir(FragmentDir, "bin", false))
+    if (Keep.find(flNotDir(File)) == Keep.end())
+      RemoveFile("PruneFragments", File);
+}
+/*}}}*/
 static bool writeBackMMapToFile(pkgCacheGenerator *const Gen, DynamicMMap *const Map,
                                 std::string const &FileName)
 {
@@ -1674,13 +2644,18 @@ static bool writeBackMMapToFile(pkgCacheGenerator *const Gen, DynamicMMap *const
 
   fchmod(SCacheF.Fd(), 0644);
 
+  if (_config->FindB("APT::Cache-Reorder", false) == true)
+    ReorderCache(Gen->GetCache());
+  if (Gen->BuildGroupIndex() == false || Gen->BuildStringIndex() == false)
+    return false;
+
   // Write out the main data
   if (SCacheF.Write(Map->Data(), Map->Size()) == false)
     return _error->Error(_("IO Error saving source cache"));
 
   // Write out the proper header
   Gen->GetCache().HeaderP->Dirty = false;
-  Gen->GetCache().HeaderP->CacheFileSize = Gen->GetCache().CacheHash();
+  Gen->GetCache().HeaderP->CacheFileSize = Gen->GetCache().CacheHash(Gen->GetCache().HeaderP->SegmentHash);
   if (SCacheF.Seek(0) == false ||
       SCacheF.Write(Map->Data(), sizeof(*Gen->GetCache().HeaderP)) == false)
     return _error->Error(_("IO Error saving source cache"));
@@ -1688,24 +2663,134 @@ static bool writeBackMMapToFile(pkgCacheGenerator *const Gen, DynamicMMap *const
   return true;
 }
 static bool loadBackMMapFromFile(std::unique_ptr<pkgCacheGenerator> &Gen,
-                                 std::unique_ptr<DynamicMMap> &Map, OpProgress *const Progress, FileFd &CacheF)
+                                 std::unique_ptr<DynamicMMap> &Map, OpProgress *const Progress, FileFd &CacheF,
+                                 map_filesize_t const IndexSize)
 {
-  Map.reset(CreateDynamicMMap(NULL, 0));
+  /* growing the map would copy the loaded cache into memory after all, so
+     leave plenty of room for the additions: untouched space costs nothing */
+  map_filesize_t const Reserve = std::max<unsigned long long>(PredictCacheSize(CacheF.Size(), IndexSize),
+                                                              std::min<unsigned long long>(CacheF.Size() + IndexSize, std::numeric_limits<map_filesize_t>::max()));
+  Map.reset(CreateDynamicMMap(NULL, 0, Reserve));
   if (unlikely(Map->validData()) == false)
     return false;
-  if (CacheF.IsOpen() == false || CacheF.Seek(0) == false || CacheF.Failed())
-    return false;
-  _error->PushToStack();
-  uint32_t const alloc = Map->RawAllocate(CacheF.Size());
-  bool const newError = _error->PendingError();
-  _error->MergeWithStack();
-  if (alloc == 0 && newError)
+  if (CacheF.IsOpen() == false || CacheF.Failed())
     return false;
-  if (CacheF.Read((unsigned char *)Map->Data() + alloc, CacheF.Size()) == false)
+  // only the pages changed by merging more files into it are copied
+  if (Map->LoadFile(CacheF) == false)
     return false;
   Gen.reset(new pkgCacheGenerator(Map.get(), Progress));
   return Gen->Start();
 }
+// UpdateCache - Merge only the changed index files into an old cache	/*{{{*/
+// ---------------------------------------------------------------------
+/* If the old cache consists of the same release and index files as the
+   sources.list describes now, the contributions of the index files which
+   have changed since are removed from it and these files are merged again.
+   Returns false if this isn't possible, in which case Gen and Map are
+   in an undefined state and the cache has to be built from scratch. */
+static bool UpdateCache(std::unique_ptr<pkgCacheGenerator> &Gen, std::unique_ptr<DynamicMMap> &Map,
+                        OpProgress *const Progress, map_filesize_t &CurrentSize, map_filesize_t &TotalSize,
+                        pkgSourceList &List, FileFd &CacheF)
+{
+  bool const Debug = _config->FindB("Debug::pkgCacheGen", false);
+  if (CacheF.IsOpen() == false || loadBackMMapFromFile(Gen, Map, Progress, CacheF, TotalSize) == false)
+    return false;
+  pkgCache &Cache = Gen->GetCache();
+
+  std::vector<bool> RlsVisited(Cache.HeaderP->ReleaseFileCount, false);
+  std::vector<bool> Visited(Cache.HeaderP->PackageFileCount, false);
+  std::vector<metaIndex *> ChangedReleases;
+  std::vector<pkgDebianIndexFile *> ChangedIndexes;
+  std::vector<pkgCache::PkgFileIterator> ChangedFiles;
+  map_filesize_t IndexSize = 0;
+  for (pkgSourceList::const_iterator i = List.begin(); i != List.end(); ++i)
+  {
+    pkgCache::RlsFileIterator const RlsFile = (*i)->FindInCache(Cache, false);
+    if (RlsFile.end() == true || RlsVisited[RlsFile->ID] == true)
+    {
+      if (Debug == true)
+        std::clog << "Can't update cache as RlsFile " << (*i)->Describe() << " is new or duplicated" << std::endl;
+      return false;
+    }
+    RlsVisited[RlsFile->ID] = true;
+    bool Changed = (*i)->FindInCache(Cache, true).end();
+
+    for (auto const I : *(*i)->GetIndexFiles())
+    {
+      if (I->HasPackages() == false)
+        continue;
+      auto const Index = dynamic_cast<pkgDebianIndexFile *>(I);
+      if (Index == nullptr)
+        return false;
+      pkgCache::PkgFileIterator const File = Index->FindInCache(Cache, false);
+      if (Index->Exists() == false && File.end() == true)
+        continue;
+      if (Index->Exists() == false || File.end() == true || Visited[File->ID] == true ||
+          File->Release != RlsFile.MapPointer())
+      {
+        if (Debug == true)
+          std::clog << "Can't update cache as PkgFile " << Index->Describe() << " is new, gone or duplicated" << std::endl;
+        return false;
+      }
+      Visited[File->ID] = true;
+      IndexSize += Index->Size();
+
+      if (Index->FindInCache(Cache).end() == false)
+        continue;
+      Changed = true;
+      ChangedIndexes.push_back(Index);
+      ChangedFiles.push_back(File);
+    }
+    if (Changed == true)
+    {
+      ChangedReleases.push_back(*i);
+      Gen->RecycleReleaseFile(RlsFile);
+    }
+  }
+  if (std::find(RlsVisited.begin(), RlsVisited.end(), false) != RlsVisited.end() ||
+      std::find(Visited.begin(), Visited.end(), false) != Visited.end())
+  {
+    if (Debug == true)
+      std::clog << "Can't update cache as some of its files are gone" << std::endl;
+    return false;
+  }
+
+  if (Debug == true)
+    std::clog << "Updating " << ChangedIndexes.size() << " of " << Visited.size() << " index files in place" << std::endl;
+  Gen->RecycleFiles(ChangedFiles);
+  // the unlinked structures are only reclaimed by building the cache again
+  map_filesize_t const Garbage = Cache.HeaderP->GarbageSize;
+  if (Garbage > Map->Size() - Garbage)
+  {
+    if (Debug == true)
+      std::clog << "Can't update cache as " << Garbage << " of its " << Map->Size() << " bytes are unused" << std::endl;
+    return false;
+  }
+  Cache.HeaderP->IndexSize = IndexSize;
+  for (auto const I : ChangedIndexes)
+    TotalSize += I->Size();
+
+  auto const Preloader = StartPreloader(*Gen, ChangedIndexes);
+  for (auto const R : ChangedReleases)
+  {
+    if (R->Merge(*Gen, Progress) == false)
+      return false;
+
+    for (auto const I : *R->GetIndexFiles())
+    {
+      if (std::find(ChangedIndexes.begin(), ChangedIndexes.end(), I) == ChangedIndexes.end())
+        continue;
+      map_filesize_t const Size = I->Size();
+      if (Progress != NULL)
+        Progress->OverallProgress(CurrentSize, TotalSize, Size, _("Reading package lists"));
+      CurrentSize += Size;
+      if (I->Merge(*Gen, Progress) == false)
+        return false;
+    }
+  }
+  return true;
+}
+/*}}}*/
 bool pkgCacheGenerator::MakeStatusCache(pkgSourceList &List, OpProgress *Progress,
                                         MMap **OutMap, bool)
 {
@@ -1784,42 +2869,74 @@ bool pkgCacheGenerator::MakeStatusCache(pkgSourceList &List, OpProgress *Progres
       std::clog << "Do we have write-access to the cache files? " << (Writeable ? "YES" : "NO") << std::endl;
   }
 
-  // At this point we know we need to construct something, so get storage ready
-  std::unique_ptr<DynamicMMap> Map(CreateDynamicMMap(NULL, 0));
-  if (unlikely(Map->validData()) == false)
-    return false;
-  if (Debug == true)
-    std::clog << "Open memory Map (not filebased)" << std::endl;
-
+  // At this point we know we need to construct something, the storage
+  // for it is reserved as soon as we know how large it will be
+  std::unique_ptr<DynamicMMap> Map;
   std::unique_ptr<pkgCacheGenerator> Gen{nullptr};
   map_filesize_t CurrentSize = 0;
   std::vector<pkgIndexFile *> VolatileFiles = List.GetVolatileFiles();
   map_filesize_t TotalSize = ComputeSize(NULL, VolatileFiles.begin(), VolatileFiles.end());
+  if (pkgcache_fine == false)
+    TotalSize += ComputeSize(NULL, Files.begin(), Files.end());
   if (srcpkgcache_fine == true && pkgcache_fine == false)
   {
     if (Debug == true)
       std::clog << "srcpkgcache.bin was valid - populate MMap with it" << std::endl;
-    if (loadBackMMapFromFile(Gen, Map, Progress, SrcCacheFile) == false)
+    if (loadBackMMapFromFile(Gen, Map, Progress, SrcCacheFile, TotalSize) == false)
       return false;
     srcpkgcache_fine = true;
-    TotalSize += ComputeSize(NULL, Files.begin(), Files.end());
   }
   else if (srcpkgcache_fine == false)
   {
-    if (Debug == true)
-      std::clog << "srcpkgcache.bin is NOT valid - rebuild" << std::endl;
-    Gen.reset(new pkgCacheGenerator(Map.get(), Progress));
-    if (Gen->Start() == false)
-      return false;
+    bool Updated = false;
+    if (_config->FindB("APT::Cache-Incremental", false) == true)
+    {
+      // errors are reported by the rebuild if updating failed
+      _error->PushToStack();
+      Updated = UpdateCache(Gen, Map, Progress, CurrentSize, TotalSize, List, SrcCacheFile);
+      if (Updated == true)
+        _error->MergeWithStack();
+      else
+      {
+        _error->RevertToStack();
+        Gen.reset();
+        Map.reset();
+        CurrentSize = 0;
+        TotalSize = ComputeSize(NULL, VolatileFiles.begin(), VolatileFiles.end()) +
+                    ComputeSize(NULL, Files.begin(), Files.end());
+      }
+    }
 
-    TotalSize += ComputeSize(&List, Files.begin(), Files.end());
-    if (BuildCache(*Gen, Progress, CurrentSize, TotalSize, &List,
-                   Files.end(), Files.end()) == false)
-      return false;
+    if (Updated == true)
+    {
+      if (Debug == true)
+        std::clog << "srcpkgcache.bin was updated - use it for pkgcache.bin" << std::endl;
+    }
+    else
+    {
+      if (Debug == true)
+        std::clog << "srcpkgcache.bin is NOT valid - rebuild" << std::endl;
+      TotalSize += ComputeSize(&List, Files.end(), Files.end());
+      map_filesize_t const Reserve = PredictCacheSize(0, TotalSize);
+      Map.reset(CreateDynamicMMap(NULL, 0, Reserve));
+      if (unlikely(Map->validData()) == false)
+        return false;
+      if (Debug == true)
+        std::clog << "Open memory Map (not filebased) predicting " << Reserve << " bytes" << std::endl;
+      Gen.reset(new pkgCacheGenerator(Map.get(), Progress));
+      if (Gen->Start() == false)
+        return false;
+
+      if (BuildCache(*Gen, Progress, CurrentSize, TotalSize, &List,
+                     Files.end(), Files.end()) == false)
+        return false;
+    }
 
     if (Writeable == true && SrcCacheFileName.empty() == false)
       if (writeBackMMapToFile(Gen.get(), Map.get(), SrcCacheFileName) == false)
         return false;
+    if (Writeable == true && _config->FindB("APT::Cache-Fragments", false) == true)
+      PruneFragments(Gen->GetCache());
   }
 
   if (pkgcache_fine == false)
@@ -1844,7 +2961,7 @@ bool pkgCacheGenerator::MakeStatusCache(pkgSourceList &List, OpProgress *Progres
     {
       if (Debug == true)
         std::clog << "Populate new MMap with cachefile contents" << std::endl;
-      if (loadBackMMapFromFile(Gen, Map, Progress, CacheFile) == false)
+      if (loadBackMMapFromFile(Gen, Map, Progress, CacheFile, TotalSize) == false)
         return false;
     }
 
@@ -1914,6 +3031,27 @@ static bool IsDuplicateDescription(pkgCache &Cache, pkgCache::DescIterator Desc,
   return false;
 }
 /*}}}*/
+// ShareDescriptionList						/*{{{*/
+/* Before we add a new description we first search in the group for
+   a version with a description of the same MD5 - if so we reuse this
+   description group instead of creating our own for this version */
+static void ShareDescriptionList(pkgCache &Cache, pkgCache::VerIterator &Ver,
+                                 APT::StringView CurMd5)
+{
+  pkgCache::GrpIterator Grp = Ver.ParentPkg().Group();
+  for (pkgCache::PkgIterator P = Grp.PackageList();
+       P.end() == false; P = Grp.NextPkg(P))
+  {
+    for (pkgCache::VerIterator V = P.VersionList();
+         V.end() == false; ++V)
+    {
+      if (V->DescriptionList == 0 || Cache.ViewString(V.DescriptionList()->md5sum) != CurMd5)
+        continue;
+      Ver->DescriptionList = V->DescriptionList;
+    }
+  }
+}
+/*}}}*/
 
-pkgCacheListParser::pkgCacheListParser() : Owner(NULL), OldDepLast(NULL), d(NULL) {}
+pkgCacheListParser::pkgCacheListParser() : Owner(NULL), OldDepLast(NULL), Architectures(APT::Configuration::getArchitectures()), d(NULL) {}
 pkgCacheListParser::~pkgCacheListParser() {}
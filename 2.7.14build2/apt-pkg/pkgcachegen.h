@@ -22,6 +22,7 @@
 #include <apt-pkg/mmap.h>
 #include <apt-pkg/pkgcache.h>
 
+#include <memory>
 #include <string>
 #include <vector>
 #if __cplusplus >= 201103L
@@ -83,12 +84,6 @@ class APT_HIDDEN pkgCacheGenerator /*{{{*/
   std::unordered_set<string_pointer, hash> strSections;
 #endif
 
-  struct VersionExtra
-  {
-    char SHA256[64];
-  };
-  std::vector<VersionExtra> VersionExtra{32 * 1024};
-
   friend class pkgCacheListParser;
   typedef pkgCacheListParser ListParser;
 
@@ -171,13 +166,50 @@ class APT_HIDDEN pkgCacheGenerator /*{{{*/
 
   void ReMap(void const *const oldMap, void *const newMap, size_t oldSize);
   bool Start();
+  /** \brief build the pkgCache::Header::GrpIndex table used by pkgCache::FindGrp */
+  bool BuildGroupIndex();
+  /** \brief add the strings stored since to the pkgCache::Header::StrIndex table */
+  bool BuildStringIndex();
+
+  /** \brief remember the sizes of this cache file to predict the size of the next cache
+   *
+   * The cache built next from a similar amount of index files will need about
+   * as much space, so #MakeStatusCache reserves that much right away instead
+   * of growing the map step by step. Only the first cache file seen counts.
+   */
+  static void RememberCacheSize(FileFd &CacheFile);
+
+  class IndexPreloader;
+  /** \brief hands out the parser for an index prepared by an #IndexPreloader
+   *
+   * \return \b false if the index wasn't (successfully) prepared, in which
+   * case the caller has to open the index itself.
+   */
+  bool TakePreloadedIndex(pkgIndexFile const *Index, std::unique_ptr<FileFd> &Pkg,
+                          std::unique_ptr<pkgCacheListParser> &Parser);
+
+  /** \brief remove everything the given package files contributed to the cache
+   *
+   * Versions and descriptions left without a file are unlinked from the cache
+   * and added to its GarbageSize. The structures left are numbered again, so
+   * that the counts in the header are those of the structures in use.
+   * The package files themselves are kept and refilled in place by the next
+   * #SelectFile call for them, so that changed index files can be merged
+   * again without rebuilding the cache from scratch.
+   */
+  void RecycleFiles(std::vector<pkgCache::PkgFileIterator> const &Files);
+  /** \brief refill this release file in place with the next #SelectReleaseFile call for it */
+  void RecycleReleaseFile(pkgCache::RlsFileIterator const &File);
 
   pkgCacheGenerator(DynamicMMap *Map, OpProgress *Progress);
   virtual ~pkgCacheGenerator();
 
   private:
   void *const d;
-  APT_HIDDEN bool MergeListGroup(ListParser &List, std::string const &GrpName);
+  IndexPreloader *Preloader;
+  std::vector<map_pointer<pkgCache::ReleaseFile>> RecycledRlsFiles;
+  std::vector<map_pointer<pkgCache::PackageFile>> RecycledFiles;
+  APT_HIDDEN bool MergeListGroup(ListParser &List, APT::StringView GrpName);
   APT_HIDDEN bool MergeListPackage(ListParser &List, pkgCache::PkgIterator &Pkg);
   APT_HIDDEN bool MergeListVersion(ListParser &List, pkgCache::PkgIterator &Pkg,
                                    APT::StringView const &Version, pkgCache::VerIterator *&OutVer);
@@ -199,6 +231,7 @@ class APT_HIDDEN pkgCacheListParser
   // Some cache items
   pkgCache::VerIterator OldDepVer;
   map_pointer<pkgCache::Dependency> *OldDepLast;
+  std::vector<std::string> Architectures;
 
   void *const d;
 
@@ -217,15 +250,19 @@ class APT_HIDDEN pkgCacheListParser
                    uint8_t const Flags);
   bool NewProvidesAllArch(pkgCache::VerIterator &Ver, APT::StringView Package,
                           APT::StringView Version, uint8_t const Flags);
+  /** \brief like APT::Configuration::checkArchitecture, but without copying the list for each call */
+  bool IsKnownArchitecture(APT::StringView Arch) const;
 
   public:
   // These all operate against the current section
-  virtual std::string Package() = 0;
+  /** \brief name of the package, valid until the next call of #Step */
+  virtual APT::StringView Package() = 0;
   virtual bool ArchitectureAll() = 0;
   virtual APT::StringView Architecture() = 0;
   virtual APT::StringView Version() = 0;
   virtual bool NewVersion(pkgCache::VerIterator &Ver) = 0;
-  virtual std::vector<std::string> AvailableDescriptionLanguages() = 0;
+  /** \brief languages of the descriptions, valid until the next call of #Step */
+  virtual std::vector<std::string> const &AvailableDescriptionLanguages() = 0;
   virtual APT::StringView Description_md5() = 0;
   virtual uint32_t VersionHash() = 0;
   /** compare currently parsed version with given version
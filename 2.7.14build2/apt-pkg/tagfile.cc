@@ -19,14 +19,33 @@
 #include <apt-pkg/tagfile-keys.h>
 #include <apt-pkg/tagfile.h>
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <list>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include <cctype>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <string>
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define APT_TAGFILE_X86_STRUCTURE
+#include <immintrin.h>
+#endif
+
 #include <apti18n.h>
 /*}}}*/
 
@@ -41,6 +60,7 @@ class APT_HIDDEN pkgTagFilePrivate /*{{{*/
     if (Buffer != NULL)
       free(Buffer);
     Buffer = NULL;
+    Unmap();
     Fd = pFd;
     Flags = pFlags;
     Start = NULL;
@@ -52,10 +72,36 @@ class APT_HIDDEN pkgTagFilePrivate /*{{{*/
     chunks.clear();
   }
 
-  pkgTagFilePrivate(FileFd *const pFd, unsigned long long const Size, pkgTagFile::Flags const pFlags) : Buffer(NULL)
+  pkgTagFilePrivate(FileFd *const pFd, unsigned long long const Size, pkgTagFile::Flags const pFlags) : Buffer(NULL), Map(NULL), MapSize(0), InMap(false)
   {
     Reset(pFd, Size, pFlags);
   }
+  /** \brief map the file read-only if it is a plain file read from its start
+   *
+   * Comments are removed while reading, so such files are always copied.
+   */
+  bool MapFile()
+  {
+    if ((Flags & pkgTagFile::SUPPORT_COMMENTS) != 0 || Fd->IsCompressed() == true)
+      return false;
+    struct stat Buf;
+    if (fstat(Fd->Fd(), &Buf) != 0 || S_ISREG(Buf.st_mode) == false || Buf.st_size == 0 || Fd->Tell() != 0)
+      return false;
+    void *const Base = mmap(NULL, Buf.st_size, PROT_READ, MAP_PRIVATE, Fd->Fd(), 0);
+    if (Base == MAP_FAILED)
+      return false;
+    Map = static_cast<char *>(Base);
+    MapSize = Buf.st_size;
+    return true;
+  }
+  void Unmap()
+  {
+    if (Map != NULL)
+      munmap(Map, MapSize);
+    Map = NULL;
+    MapSize = 0;
+    InMap = false;
+  }
   FileFd *Fd;
   pkgTagFile::Flags Flags;
   char *Buffer;
@@ -72,11 +118,16 @@ class APT_HIDDEN pkgTagFilePrivate /*{{{*/
     FileChunk(bool const pgood, size_t const plength) noexcept : good(pgood), length(plength) {}
   };
   std::list<FileChunk> chunks;
+  // the complete file if it is mapped and if Start and End point into it
+  char *Map;
+  size_t MapSize;
+  bool InMap;
 
   ~pkgTagFilePrivate()
   {
     if (Buffer != NULL)
       free(Buffer);
+    Unmap();
   }
 };
 /*}}}*/
@@ -96,6 +147,9 @@ class APT_HIDDEN pkgTagSectionPrivate /*{{{*/
     explicit TagData(unsigned int const StartTag) : StartTag(StartTag), EndTag(0), StartValue(0), NextInBucket(0) {}
   };
   std::vector<TagData> Tags;
+  // reused by Write to avoid allocations
+  std::vector<struct iovec> WritePieces;
+  std::vector<bool> WrittenTags;
 };
 /*}}}*/
 
@@ -114,6 +168,150 @@ static unsigned long BetaHash(const char *Text, size_t Length) /*{{{*/
   return Res & 0x7F;
 }
 /*}}}*/
+// TagStructure - Find the newlines, colons and blanks of a section	/*{{{*/
+// ---------------------------------------------------------------------
+/* Scan is mostly busy finding the end of each field and the colon after each
+   tag. Instead of searching for them byte by byte, the bitmasks of newlines,
+   colons and blanks are computed for 64 bytes at once with the widest vector
+   instructions the CPU has and the positions are read from the bits. A field
+   ends at a newline not followed by a blank, so the continuation lines of a
+   long value are skipped a block at a time. Without such instructions memchr
+   is used, which is the fastest a plain loop can do anyhow. */
+namespace
+{
+typedef void (*StructureFunc)(char const *Data, uint64_t &Newlines, uint64_t &Colons, uint64_t &Blanks);
+
+#ifdef APT_TAGFILE_X86_STRUCTURE
+__attribute__((target("sse2"))) void StructureSSE2(char const *const Data, uint64_t &Newlines, uint64_t &Colons, uint64_t &Blanks)
+{
+  __m128i const Newline = _mm_set1_epi8('\n');
+  __m128i const Colon = _mm_set1_epi8(':');
+  __m128i const Space = _mm_set1_epi8(' ');
+  __m128i const Tab = _mm_set1_epi8('\t');
+  Newlines = Colons = Blanks = 0;
+  for (unsigned int I = 0; I < 4; ++I)
+  {
+    __m128i const Chunk = _mm_loadu_si128(reinterpret_cast<__m128i const *>(Data + 16 * I));
+    __m128i const Blank = _mm_or_si128(_mm_cmpeq_epi8(Chunk, Space), _mm_cmpeq_epi8(Chunk, Tab));
+    Newlines |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(Chunk, Newline)))) << (16 * I);
+    Colons |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(Chunk, Colon)))) << (16 * I);
+    Blanks |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(Blank))) << (16 * I);
+  }
+}
+__attribute__((target("avx2"))) uint64_t MaskAVX2(__m256i const Low, __m256i const High, __m256i const Character)
+{
+  return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(Low, Character))) |
+         static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(High, Character)))) << 32;
+}
+__attribute__((target("avx2"))) void StructureAVX2(char const *const Data, uint64_t &Newlines, uint64_t &Colons, uint64_t &Blanks)
+{
+  __m256i const Low = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(Data));
+  __m256i const High = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(Data + 32));
+  Newlines = MaskAVX2(Low, High, _mm256_set1_epi8('\n'));
+  Colons = MaskAVX2(Low, High, _mm256_set1_epi8(':'));
+  Blanks = MaskAVX2(Low, High, _mm256_set1_epi8(' ')) | MaskAVX2(Low, High, _mm256_set1_epi8('\t'));
+}
+#endif
+StructureFunc ChooseStructureFunc()
+{
+#ifdef APT_TAGFILE_X86_STRUCTURE
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return StructureAVX2;
+  if (__builtin_cpu_supports("sse2"))
+    return StructureSSE2;
+#endif
+  return nullptr;
+}
+StructureFunc const FindStructure = ChooseStructureFunc();
+
+class TagStructure
+{
+  static constexpr size_t BlockSize = 64;
+  char const *const End;
+  char const *Block;
+  uint64_t Newlines;
+  uint64_t Colons;
+  uint64_t Blanks;
+
+  static bool IsBlank(char const C) { return C == ' ' || C == '\t'; }
+  /** \brief the first byte at or after \b From whose bit is set in the mask \b Bits returns */
+  template <typename Mask>
+  char const *Find(char const *From, Mask const &Bits)
+  {
+    while (From < End)
+    {
+      if (From < Block || static_cast<size_t>(From - Block) >= BlockSize)
+      {
+        Block = From;
+        if (static_cast<size_t>(End - Block) >= BlockSize)
+          FindStructure(Block, Newlines, Colons, Blanks);
+        else
+        {
+          // the end of the buffer is padded with bytes which aren't searched for
+          char Tail[BlockSize] = {};
+          memcpy(Tail, Block, End - Block);
+          FindStructure(Tail, Newlines, Colons, Blanks);
+        }
+      }
+      uint64_t const Found = Bits() >> (From - Block);
+      if (Found != 0)
+      {
+        From += __builtin_ctzll(Found);
+        return From < End ? From : nullptr;
+      }
+      From = Block + BlockSize;
+    }
+    return nullptr;
+  }
+
+  public:
+  explicit TagStructure(char const *const End) : End(End), Block(End), Newlines(0), Colons(0), Blanks(0) {}
+  /** \brief the first newline at or after \b From or \b nullptr */
+  char const *Newline(char const *const From)
+  {
+    if (FindStructure == nullptr)
+      return static_cast<char const *>(memchr(From, '\n', End - From));
+    return Find(From, [this]() { return Newlines; });
+  }
+  /** \brief the first colon at or after \b From or \b nullptr */
+  char const *Colon(char const *const From)
+  {
+    if (FindStructure == nullptr)
+      return static_cast<char const *>(memchr(From, ':', End - From));
+    return Find(From, [this]() { return Colons; });
+  }
+  /** \brief the first byte at or after \b From which isn't a space or tab, or \b End */
+  char const *NonBlank(char const *From)
+  {
+    if (FindStructure == nullptr)
+    {
+      for (; From < End && IsBlank(*From); ++From)
+        ;
+      return From;
+    }
+    From = Find(From, [this]() { return ~Blanks; });
+    return From == nullptr ? End : From;
+  }
+  /** \brief the first newline at or after \b From which isn't followed by a
+   * continuation line, or \b nullptr */
+  char const *FieldEnd(char const *From)
+  {
+    while (true)
+    {
+      // the blank after a newline at the end of a block isn't known yet
+      if (FindStructure == nullptr)
+        From = Newline(From);
+      else
+        From = Find(From, [this]() { return Newlines & ~(Blanks >> 1); });
+      if (From == nullptr || From + 1 == End || IsBlank(From[1]) == false)
+        return From;
+      ++From;
+    }
+  }
+};
+} // namespace
+/*}}}*/
 
 // TagFile::pkgTagFile - Constructor					/*{{{*/
 pkgTagFile::pkgTagFile(FileFd *const pFd, pkgTagFile::Flags const pFlags, unsigned long long const Size)
@@ -136,6 +334,15 @@ void pkgTagFile::Init(FileFd *const pFd, pkgTagFile::Flags const pFlags, unsigne
 
   if (d->Fd->IsOpen() == false)
     d->Start = d->End = d->Buffer = 0;
+  else if ((pFlags & pkgTagFile::MMAP) != 0 && d->MapFile() == true)
+  {
+    // the sections are scanned right in the map, nothing is read
+    d->Start = d->Map;
+    d->End = d->Map + d->MapSize;
+    d->InMap = true;
+    d->Done = true;
+    return;
+  }
   else
     d->Buffer = (char *)malloc(sizeof(char) * Size);
 
@@ -384,9 +591,23 @@ static void RemoveCommentsFromBuffer(pkgTagFilePrivate *const d)
 bool pkgTagFile::Fill()
 {
   unsigned long long const EndSize = d->End - d->Start;
+  if (d->InMap == true)
+  {
+    /* The rest of the file is in the map already, but the last section
+       lacks the newlines ending it, which can only be added to a copy */
+    char *const newBuffer = static_cast<char *>(realloc(d->Buffer, EndSize + 4));
+    if (newBuffer == NULL)
+      return false;
+    memcpy(newBuffer, d->Start, EndSize);
+    d->Buffer = d->Start = newBuffer;
+    d->End = d->Buffer + EndSize;
+    d->Size = EndSize + 4;
+    d->InMap = false;
+  }
   if (EndSize != 0)
   {
-    memmove(d->Buffer, d->Start, EndSize);
+    if (d->Start != d->Buffer)
+      memmove(d->Buffer, d->Start, EndSize);
     d->Start = d->End = d->Buffer + EndSize;
   }
   else
@@ -426,12 +647,319 @@ bool pkgTagFile::Fill()
   return true;
 }
 /*}}}*/
+// TagFile::Preload - Read the rest of the file into the buffer		/*{{{*/
+// ---------------------------------------------------------------------
+/* The buffer is grown as needed, so unlike Fill this can't fail on
+   overlong sections, it is just limited by the available memory */
+bool pkgTagFile::Preload()
+{
+  if (d->InMap == true)
+  {
+    // just get the kernel to read the file in the meantime
+    madvise(d->Start, d->End - d->Start, MADV_WILLNEED);
+    return true;
+  }
+  if (d->Buffer == NULL || d->Done == true || (d->Flags & pkgTagFile::SUPPORT_COMMENTS) != 0)
+    return true;
+
+  unsigned long long const EndSize = d->End - d->Start;
+  if (d->Start != d->Buffer)
+  {
+    memmove(d->Buffer, d->Start, EndSize);
+    d->Start = d->Buffer;
+    d->End = d->Buffer + EndSize;
+  }
+
+  while (d->Done == false)
+  {
+    if (d->Size - (d->End - d->Buffer) < 64 * 1024)
+      if (Resize(d->Size * 2) == false)
+        return _error->Error(_("Unable to parse package file %s (%d)"), d->Fd->Name().c_str(), 3);
+    if (FillBuffer(d) == false)
+      return false;
+  }
+  if (d->Size - (d->End - d->Buffer) < 4 && Resize(d->Size + 4) == false)
+    return _error->Error(_("Unable to parse package file %s (%d)"), d->Fd->Name().c_str(), 3);
+  // let Fill add the missing newlines at the end, as it would have done
+  // while reading the last chunk – its return value is only interesting
+  // for Step in this case
+  Fill();
+  return true;
+}
+/*}}}*/
+// TagFile::ForEachSection - Scan the remaining sections in parallel	/*{{{*/
+// ---------------------------------------------------------------------
+/* The buffer is split into chunks of about SectionChunkSize bytes at the
+   empty lines ending sections, so each chunk can be scanned on its own.
+   Whatever follows the last empty line, like a last section without its
+   newlines, is left to Step. Unordered, each thread takes the next chunk
+   and calls the callback itself. Ordered, helpers scan the next chunks
+   into a ring of sections while the calling thread hands out the sections
+   of the oldest one, scanning it itself if no helper has picked it up. */
+static constexpr size_t SectionChunkSize = 64 * 1024;
+// the start of the section after the empty line following From, if any
+static char const *NextSectionStart(char const *From, char const *const End)
+{
+  while ((From = static_cast<char const *>(memchr(From, '\n', End - From))) != nullptr)
+  {
+    ++From;
+    for (; From < End && *From == '\r'; ++From)
+      ;
+    if (From < End && *From == '\n')
+    {
+      // like TrimRecord, the empty lines belong to the section before
+      for (; From < End && (*From == '\n' || *From == '\r'); ++From)
+        ;
+      return From;
+    }
+  }
+  return nullptr;
+}
+static void PassOnMessages(std::mutex &Lock, std::vector<std::pair<GlobalError::MsgType, std::string>> &Messages)
+{
+  std::lock_guard<std::mutex> Guard(Lock);
+  std::string Text;
+  GlobalError::MsgType Type;
+  while (_error->PopMessage(Text, Type))
+    Messages.emplace_back(Type, Text);
+}
+bool pkgTagFile::ForEachSection(std::function<bool(pkgTagSection &Section, unsigned long long Offset)> const &Callback,
+                                bool const Ordered, unsigned int Threads)
+{
+  if (Threads == 0)
+    Threads = std::max(1u, std::thread::hardware_concurrency());
+  if ((d->Flags & pkgTagFile::SUPPORT_COMMENTS) == 0 && Threads > 1)
+  {
+    if (Preload() == false)
+      return false;
+
+    char const *const Begin = d->Start;
+    char const *const End = d->End;
+    std::vector<char const *> Chunks{Begin};
+    while (true)
+    {
+      char const *Next = nullptr;
+      if (static_cast<size_t>(End - Chunks.back()) > SectionChunkSize)
+        Next = NextSectionStart(Chunks.back() + SectionChunkSize, End);
+      if (Next == nullptr)
+      {
+        for (char const *N = Chunks.back(); (N = NextSectionStart(N, End)) != nullptr;)
+          Next = N;
+        if (Next != nullptr)
+          Chunks.push_back(Next);
+        break;
+      }
+      Chunks.push_back(Next);
+    }
+
+    size_t const ChunkCount = Chunks.size() - 1;
+    if (ChunkCount > 1)
+    {
+      unsigned long long const BaseOffset = d->iOffset;
+      std::vector<std::thread> Helpers;
+      auto const StartHelpers = [&](size_t const Count, std::function<void()> const &Helper)
+      {
+        for (size_t I = 0; I < Count; ++I)
+        {
+          try
+          {
+            Helpers.emplace_back(Helper);
+          }
+          catch (std::system_error const &)
+          {
+            // the chunks are picked up by the threads we have
+            break;
+          }
+        }
+      };
+      bool Continue = true;
+      bool Failed = false;
+
+      if (Ordered == false)
+      {
+        std::atomic<size_t> NextChunk{0};
+        std::atomic<bool> Stopped{false};
+        std::atomic<bool> ScanFailed{false};
+        auto const ScanChunks = [&]()
+        {
+          pkgTagSection Section;
+          for (size_t C = NextChunk++; C < ChunkCount && Stopped == false; C = NextChunk++)
+          {
+            for (char const *S = Chunks[C]; S < Chunks[C + 1] && Stopped == false;)
+            {
+              if (Section.Scan(S, Chunks[C + 1] - S) == false)
+              {
+                ScanFailed = true;
+                Stopped = true;
+                break;
+              }
+              unsigned long long const Offset = BaseOffset + (S - Begin);
+              S += Section.size();
+              Section.Trim();
+              if (Callback(Section, Offset) == false)
+                Stopped = true;
+            }
+          }
+        };
+        std::mutex Lock;
+        std::vector<std::pair<GlobalError::MsgType, std::string>> Messages;
+        auto const Helper = [&]()
+        {
+          ScanChunks();
+          PassOnMessages(Lock, Messages);
+        };
+        StartHelpers(std::min<size_t>(Threads, ChunkCount) - 1, Helper);
+        ScanChunks();
+        for (auto &Helper : Helpers)
+          Helper.join();
+        for (auto const &M : Messages)
+          _error->Insert(M.first, "%s", M.second.c_str());
+        Failed = ScanFailed;
+        Continue = Stopped == false;
+      }
+      else
+      {
+        struct Slot
+        {
+          std::vector<std::unique_ptr<pkgTagSection>> Sections;
+          size_t Count = 0;
+          bool Scanned = false;
+          bool Failed = false;
+        };
+        size_t const Ring = 2 * Threads;
+        std::vector<Slot> Slots(Ring);
+        auto const ScanChunk = [&](size_t const C)
+        {
+          Slot &Chunk = Slots[C % Ring];
+          Chunk.Count = 0;
+          Chunk.Failed = false;
+          for (char const *S = Chunks[C]; S < Chunks[C + 1]; ++Chunk.Count)
+          {
+            if (Chunk.Count == Chunk.Sections.size())
+              Chunk.Sections.emplace_back(new pkgTagSection());
+            pkgTagSection &Section = *Chunk.Sections[Chunk.Count];
+            if (Section.Scan(S, Chunks[C + 1] - S) == false)
+            {
+              Chunk.Failed = true;
+              break;
+            }
+            S += Section.size();
+            Section.Trim();
+          }
+        };
+        std::mutex Lock;
+        std::condition_variable Changed;
+        size_t NextChunk = 0;
+        size_t Delivered = 0;
+        bool Stopped = false;
+        auto const Helper = [&]()
+        {
+          std::unique_lock<std::mutex> Guard(Lock);
+          while (true)
+          {
+            Changed.wait(Guard, [&]
+                         { return Stopped || NextChunk >= ChunkCount || NextChunk < Delivered + Ring; });
+            if (Stopped || NextChunk >= ChunkCount)
+              return;
+            size_t const C = NextChunk++;
+            Guard.unlock();
+            ScanChunk(C);
+            Guard.lock();
+            Slots[C % Ring].Scanned = true;
+            Changed.notify_all();
+          }
+        };
+        StartHelpers(std::min<size_t>(Threads - 1, ChunkCount), Helper);
+        for (size_t C = 0; C < ChunkCount && Continue == true; ++C)
+        {
+          Slot &Chunk = Slots[C % Ring];
+          {
+            std::unique_lock<std::mutex> Guard(Lock);
+            if (NextChunk == C)
+            {
+              ++NextChunk;
+              Guard.unlock();
+              ScanChunk(C);
+            }
+            else
+              Changed.wait(Guard, [&]
+                           { return Chunk.Scanned; });
+          }
+          for (size_t I = 0; I < Chunk.Count && Continue == true; ++I)
+          {
+            char const *Start, *Stop;
+            Chunk.Sections[I]->GetSection(Start, Stop);
+            Continue = Callback(*Chunk.Sections[I], BaseOffset + (Start - Begin));
+          }
+          if (Chunk.Failed == true && Continue == true)
+          {
+            Failed = true;
+            Continue = false;
+          }
+          std::lock_guard<std::mutex> Guard(Lock);
+          Chunk.Scanned = false;
+          ++Delivered;
+          Changed.notify_all();
+        }
+        {
+          std::lock_guard<std::mutex> Guard(Lock);
+          Stopped = true;
+          Changed.notify_all();
+        }
+        for (auto &Helper : Helpers)
+          Helper.join();
+      }
+
+      d->Start += Chunks.back() - Begin;
+      d->iOffset += Chunks.back() - Begin;
+      if (Failed == true)
+        return _error->Error(_("Unable to parse package file %s (%d)"), d->Fd->Name().c_str(), 4);
+      if (Continue == false)
+        return false;
+    }
+  }
+
+  // whatever is left is stepped through as usual
+  _error->PushToStack();
+  pkgTagSection Section;
+  bool Continue = true;
+  while (Continue == true)
+  {
+    unsigned long long const Offset = d->iOffset;
+    if (Step(Section) == false)
+      break;
+    Continue = Callback(Section, Offset);
+  }
+  bool const Failed = _error->PendingError();
+  _error->MergeWithStack();
+  return Continue == true && Failed == false;
+}
+/*}}}*/
 // TagFile::Jump - Jump to a pre-recorded location in the file		/*{{{*/
 // ---------------------------------------------------------------------
 /* This jumps to a pre-recorded file location and reads the record
    that is there */
 bool pkgTagFile::Jump(pkgTagSection &Tag, unsigned long long Offset)
 {
+  if (d->Map != NULL)
+  {
+    if (Offset >= d->MapSize)
+      return false;
+    d->Start = d->Map + Offset;
+    d->End = d->Map + d->MapSize;
+    d->InMap = true;
+    d->iOffset = Offset;
+
+    if (Tag.Scan(d->Start, d->End - d->Start) == true)
+      return true;
+    // the last section might need the newlines Fill adds
+    if (Fill() == false)
+      return false;
+    if (Tag.Scan(d->Start, d->End - d->Start, false) == false)
+      return _error->Error(_("Unable to parse package file %s (%d)"), d->Fd->Name().c_str(), 2);
+    return true;
+  }
+
   // Head back to the start of the buffer, in case we get called for the same section
   // again (d->Start will point to next section already)
   d->iOffset -= d->Start - d->Buffer;
@@ -491,13 +1019,14 @@ bool pkgTagSection::Scan(const char *Start, unsigned long MaxLength, bool const
 {
   Section = Start;
   const char *End = Start + MaxLength;
+  TagStructure Structure(End);
 
   if (Restart == false && d->Tags.empty() == false)
   {
     Stop = Section + d->Tags.back().StartTag;
     if (End <= Stop)
       return false;
-    Stop = (const char *)memchr(Stop, '\n', End - Stop);
+    Stop = Structure.Newline(Stop);
     if (Stop == NULL)
       return false;
     ++Stop;
@@ -552,7 +1081,7 @@ bool pkgTagSection::Scan(const char *Start, unsigned long MaxLength, bool const
       ++TagCount;
       lastTagData = pkgTagSectionPrivate::TagData(Stop - Section);
       // find the colon separating tag and value
-      char const *Colon = (char const *)memchr(Stop, ':', End - Stop);
+      char const *Colon = Structure.Colon(Stop);
       if (Colon == NULL)
         return false;
       // find the end of the tag (which might or might not be the colon)
@@ -566,16 +1095,16 @@ bool pkgTagSection::Scan(const char *Start, unsigned long MaxLength, bool const
       if (lastTagKey == Key::Unknown)
         lastTagHash = BetaHash(Stop, EndTag - Stop);
       // find the beginning of the value
-      Stop = Colon + 1;
+      Stop = Structure.NonBlank(Colon + 1);
       for (; Stop < End && isspace_ascii(*Stop) != 0; ++Stop)
-        if (*Stop == '\n' && Stop[1] != ' ')
+        if (*Stop == '\n' && (Stop + 1 == End || Stop[1] != ' '))
           break;
       if (Stop >= End)
         return false;
       lastTagData.StartValue = Stop - Section;
     }
 
-    Stop = (const char *)memchr(Stop, '\n', End - Stop);
+    Stop = Structure.FieldEnd(Stop);
 
     if (Stop == 0)
       return false;
@@ -985,88 +1514,124 @@ pkgTagSection::Tag pkgTagSection::Tag::Rewrite(std::string const &Name, std::str
   else
     return Tag(REWRITE, Name, Data);
 }
-static bool WriteTag(FileFd &File, std::string Tag, StringView Value)
+/* The fields are collected as pieces pointing to the section, the tag
+   order and the rewrites, which are written all at once at the end. Where
+   a field is unchanged the piece covers the line in the section itself and
+   adjacent pieces are merged, so an unchanged run of fields is one piece. */
+static void AddPiece(std::vector<struct iovec> &Pieces, char const *const Data, size_t const Length)
+{
+  if (Length == 0)
+    return;
+  if (Pieces.empty() == false)
+  {
+    struct iovec &Last = Pieces.back();
+    if (static_cast<char const *>(Last.iov_base) + Last.iov_len == Data)
+    {
+      Last.iov_len += Length;
+      return;
+    }
+  }
+  Pieces.push_back({const_cast<char *>(Data), Length});
+}
+static void WriteTag(std::vector<struct iovec> &Pieces, char const *const Begin, char const *const End,
+                     StringView Tag, StringView Value)
 {
-  if (Value.empty() || isspace_ascii(Value[0]) != 0)
-    Tag.append(":");
+  static char const Separator[] = ": ";
+  size_t const SeparatorLength = (Value.empty() || isspace_ascii(Value[0]) != 0) ? 1 : 2;
+  size_t const HeadLength = Tag.length() + SeparatorLength;
+  char const *const Head = Value.data() - HeadLength;
+  if (Value.data() >= Begin + HeadLength && Value.data() <= End &&
+      memcmp(Head, Tag.data(), Tag.length()) == 0 && memcmp(Head + Tag.length(), Separator, SeparatorLength) == 0)
+    AddPiece(Pieces, Head, HeadLength + Value.length());
+  else
+  {
+    AddPiece(Pieces, Tag.data(), Tag.length());
+    AddPiece(Pieces, Separator, SeparatorLength);
+    AddPiece(Pieces, Value.data(), Value.length());
+  }
+  char const *const Newline = Value.data() + Value.length();
+  if (Newline >= Begin && Newline < End && *Newline == '\n')
+    AddPiece(Pieces, Newline, 1);
   else
-    Tag.append(": ");
-  Tag.append(Value.data(), Value.length());
-  Tag.append("\n");
-  return File.Write(Tag.c_str(), Tag.length());
+    AddPiece(Pieces, "\n", 1);
 }
-static bool RewriteTags(FileFd &File, pkgTagSection const *const This, char const *const Tag,
+static void RewriteTags(std::vector<struct iovec> &Pieces, char const *const Begin, char const *const End,
+                        pkgTagSection const *const This, StringView const Tag,
                         std::vector<pkgTagSection::Tag>::const_iterator &R,
                         std::vector<pkgTagSection::Tag>::const_iterator const &REnd)
 {
-  size_t const TagLen = strlen(Tag);
   for (; R != REnd; ++R)
   {
-    std::string data;
-    if (R->Name.length() == TagLen && strncasecmp(R->Name.c_str(), Tag, R->Name.length()) == 0)
+    StringView data;
+    if (R->Name.length() == Tag.length() && strncasecmp(R->Name.c_str(), Tag.data(), Tag.length()) == 0)
     {
       if (R->Action != pkgTagSection::Tag::REWRITE)
         break;
       data = R->Data;
     }
-    else if (R->Action == pkgTagSection::Tag::RENAME && R->Data.length() == TagLen &&
-             strncasecmp(R->Data.c_str(), Tag, R->Data.length()) == 0)
-      data = This->FindRaw(R->Name.c_str()).to_string();
+    else if (R->Action == pkgTagSection::Tag::RENAME && R->Data.length() == Tag.length() &&
+             strncasecmp(R->Data.c_str(), Tag.data(), Tag.length()) == 0)
+      data = This->FindRaw(R->Name);
     else
       continue;
 
-    return WriteTag(File, Tag, data);
+    WriteTag(Pieces, Begin, End, Tag, data);
+    return;
   }
-  return true;
+}
+static bool IsOrdered(char const *const *const Order, StringView const Tag)
+{
+  for (unsigned int I = 0; Order[I] != 0; ++I)
+    if (strncasecmp(Tag.data(), Order[I], Tag.length()) == 0 && Order[I][Tag.length()] == '\0')
+      return true;
+  return false;
 }
 bool pkgTagSection::Write(FileFd &File, char const *const *const Order, std::vector<Tag> const &Rewrite) const
 {
+  std::vector<struct iovec> &Pieces = d->WritePieces;
+  Pieces.clear();
+  // the fields found for an order entry, all others are looked up in the order
+  d->WrittenTags.assign(d->Tags.size(), false);
+
   // first pass: Write everything we have an order for
   if (Order != NULL)
   {
     for (unsigned int I = 0; Order[I] != 0; ++I)
     {
+      StringView const Name = Order[I];
+      unsigned int Pos;
+      bool const Exists = Find(Name, Pos);
+      if (Exists == true)
+        d->WrittenTags[Pos] = true;
+
       std::vector<Tag>::const_iterator R = Rewrite.begin();
-      if (RewriteTags(File, this, Order[I], R, Rewrite.end()) == false)
-        return false;
+      RewriteTags(Pieces, Section, Stop, this, Name, R, Rewrite.end());
       if (R != Rewrite.end())
         continue;
 
-      if (Exists(Order[I]) == false)
+      if (Exists == false)
         continue;
 
-      if (WriteTag(File, Order[I], FindRaw(Order[I])) == false)
-        return false;
+      WriteTag(Pieces, Section, Stop, Name, FindRawInternal(Pos));
     }
   }
   // second pass: See if we have tags which aren't ordered
   if (d->Tags.empty() == false)
   {
-    for (std::vector<pkgTagSectionPrivate::TagData>::const_iterator T = d->Tags.begin(); T != d->Tags.end() - 1; ++T)
+    for (size_t T = 0; T + 1 < d->Tags.size(); ++T)
     {
-      char const *const fieldname = Section + T->StartTag;
-      size_t fieldnamelen = T->EndTag - T->StartTag;
-      if (Order != NULL)
-      {
-        unsigned int I = 0;
-        for (; Order[I] != 0; ++I)
-        {
-          if (fieldnamelen == strlen(Order[I]) && strncasecmp(fieldname, Order[I], fieldnamelen) == 0)
-            break;
-        }
-        if (Order[I] != 0)
-          continue;
-      }
+      if (d->WrittenTags[T] == true)
+        continue;
+      StringView const Name(Section + d->Tags[T].StartTag, d->Tags[T].EndTag - d->Tags[T].StartTag);
+      if (Order != NULL && IsOrdered(Order, Name))
+        continue;
 
-      std::string const name(fieldname, fieldnamelen);
       std::vector<Tag>::const_iterator R = Rewrite.begin();
-      if (RewriteTags(File, this, name.c_str(), R, Rewrite.end()) == false)
-        return false;
+      RewriteTags(Pieces, Section, Stop, this, Name, R, Rewrite.end());
       if (R != Rewrite.end())
         continue;
 
-      if (WriteTag(File, name, FindRaw(name)) == false)
-        return false;
+      WriteTag(Pieces, Section, Stop, Name, FindRaw(Name));
     }
   }
   // last pass: see if there are any rewrites remaining we haven't done yet
@@ -1074,25 +1639,15 @@ bool pkgTagSection::Write(FileFd &File, char const *const *const Order, std::vec
   {
     if (R->Action == Tag::REMOVE)
       continue;
-    auto const name = ((R->Action == Tag::RENAME) ? R->Data : R->Name);
-    if (Exists(name))
+    std::string const &Name = ((R->Action == Tag::RENAME) ? R->Data : R->Name);
+    if (Exists(Name))
+      continue;
+    if (Order != NULL && IsOrdered(Order, Name))
       continue;
-    if (Order != NULL)
-    {
-      unsigned int I = 0;
-      for (; Order[I] != 0; ++I)
-      {
-        if (strncasecmp(name.c_str(), Order[I], name.length()) == 0 && name.length() == strlen(Order[I]))
-          break;
-      }
-      if (Order[I] != 0)
-        continue;
-    }
 
-    if (WriteTag(File, name, ((R->Action == Tag::RENAME) ? FindRaw(R->Name) : R->Data)) == false)
-      return false;
+    WriteTag(Pieces, Section, Stop, Name, ((R->Action == Tag::RENAME) ? FindRaw(R->Name) : StringView(R->Data)));
   }
-  return true;
+  return Pieces.empty() || File.Write(Pieces.data(), Pieces.size());
 }
 /*}}}*/
 
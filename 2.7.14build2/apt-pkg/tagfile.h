@@ -25,6 +25,7 @@
 #include <cstdio>
 
 #include <apt-pkg/string_view.h>
+#include <functional>
 #include <list>
 #include <string>
 #include <vector>
@@ -188,10 +189,46 @@ class APT_PUBLIC pkgTagFile
   unsigned long Offset();
   bool Jump(pkgTagSection &Tag, unsigned long long Offset);
 
+  /** \brief reads the remaining file into memory
+   *
+   * Afterwards #Step only works on the in-memory buffer without touching
+   * the file again, which allows doing the (decompressing) reading
+   * e.g. in another thread than the one parsing the sections.
+   * Files with SUPPORT_COMMENTS set are left alone.
+   */
+  APT_HIDDEN bool Preload();
+
+  /** \brief calls the callback for each of the remaining sections using several threads
+   *
+   * The rest of the file is read into memory (see #Preload) and split into
+   * chunks at the empty lines between sections, which are scanned in parallel.
+   * Files with comments and small files are stepped through by the calling
+   * thread alone. Afterwards the file is at its end.
+   *
+   * @param Callback gets each section with its offset as #Offset would
+   *  have reported it before the #Step to it; returning \b false stops the
+   *  iteration. The section is only valid during the call.
+   * @param Ordered if \b true, the callback is only called by the calling
+   *  thread and in the order of the file, while the following sections are
+   *  scanned in the background. Otherwise it is called concurrently by all
+   *  threads in no particular order; messages they add to \b _error are
+   *  passed on to the calling thread at the end.
+   * @param Threads to use at most, \b 0 for one per CPU
+   * @return \b false if a callback returned \b false or an error occurred
+   */
+  bool ForEachSection(std::function<bool(pkgTagSection &Section, unsigned long long Offset)> const &Callback,
+                      bool const Ordered, unsigned int Threads = 0);
+
   enum Flags
   {
     STRICT = 0,
     SUPPORT_COMMENTS = 1 << 0,
+    /** map plain files instead of reading them into a buffer
+     *
+     * The sections are scanned in place and #Jump only points to them.
+     * Compressed files, pipes and files with comments are read as usual.
+     * The file must not be changed while the pkgTagFile is in use. */
+    MMAP = 1 << 1,
   };
 
   void Init(FileFd *const F, pkgTagFile::Flags const Flags, unsigned long long Size = 32 * 1024);
@@ -191,6 +191,7 @@ bool DoDownload(CommandLine &CmdL)
   std::vector<std::string> storefile(verset.size());
   std::string const cwd = SafeGetCWD();
   _config->Set("Dir::Cache::Archives", cwd);
+  _config->Set("APT::Remember-Archive-Hashes", false);
   int i = 0;
   for (APT::VersionSet::const_iterator Ver = verset.begin();
        Ver != verset.end(); ++Ver, ++i)
@@ -308,6 +309,7 @@ static bool CleanDownloadDirectories(bool const ListsToo)
 {
   std::string const archivedir = _config->FindDir("Dir::Cache::archives");
   std::string const listsdir = _config->FindDir("Dir::state::lists");
+  std::string const fragmentdir = _config->FindDir("Dir::Cache::fragments");
 
   if (_config->FindB("APT::Get::Simulate") == true)
   {
@@ -318,6 +320,8 @@ static bool CleanDownloadDirectories(bool const ListsToo)
     if (ListsToo)
       std::cout << "Del " << listsdir << "*_{Packages,Sources,Translation-*}" << std::endl;
     std::cout << "Del " << pkgcache << " " << srcpkgcache << std::endl;
+    if (not fragmentdir.empty() && DirectoryExists(fragmentdir))
+      std::cout << "Del " << fragmentdir << "*.bin" << std::endl;
     return true;
   }
 
@@ -339,6 +343,10 @@ static bool CleanDownloadDirectories(bool const ListsToo)
 
   pkgCacheFile::RemoveCaches();
 
+  if (not fragmentdir.empty() && DirectoryExists(fragmentdir))
+    for (auto const &File : GetListOfFilesInDir(fragmentdir, "bin", false))
+      RemoveFile("DoClean", File);
+
   return true;
 }
 bool DoClean(CommandLine &)
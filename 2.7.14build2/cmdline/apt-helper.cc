@@ -153,6 +153,7 @@ static bool DoCatFile(CommandLine &CmdL) /*{{{*/
   FileFd fd;
   FileFd out;
   std::string const compressorName = _config->Find("Apt-Helper::Cat-File::Compress", "");
+  unsigned int const ReadAhead = _config->FindB("Apt-Helper::Cat-File::ReadAhead", false) ? FileFd::ReadAhead : 0;
 
   if (compressorName.empty() == false)
   {
@@ -187,7 +188,7 @@ static bool DoCatFile(CommandLine &CmdL) /*{{{*/
 
     if (name != "-")
     {
-      if (fd.Open(name, FileFd::ReadOnly, FileFd::Extension) == false)
+      if (fd.Open(name, FileFd::ReadOnly | ReadAhead, FileFd::Extension) == false)
         return false;
     }
     else
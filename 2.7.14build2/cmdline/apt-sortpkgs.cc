@@ -74,13 +74,11 @@ static bool DoIt(string InFile)
   if (_error->PendingError() == true)
     return false;
 
-  // Parse.
+  // Parse, scanning ahead in parallel
   vector<PkgName> List;
-  pkgTagSection Section;
   unsigned long Largest = 0;
-  unsigned long Offset = Tags.Offset();
   bool Source = _config->FindB("APT::SortPkgs::Source", false);
-  while (Tags.Step(Section) == true)
+  auto const AddPackage = [&](pkgTagSection &Section, unsigned long long const Offset)
   {
     PkgName Tmp;
 
@@ -99,10 +97,10 @@ static bool DoIt(string InFile)
       Largest = Tmp.Length;
 
     List.push_back(Tmp);
-
-    Offset = Tags.Offset();
-  }
-  if (_error->PendingError() == true)
+    return true;
+  };
+  bool const Parsed = Tags.ForEachSection(AddPackage, true);
+  if (Parsed == false || _error->PendingError() == true)
     return false;
 
   // Sort it
@@ -114,8 +112,9 @@ static bool DoIt(string InFile)
 
   // Emit
   FileFd stdoutfd;
-  stdoutfd.OpenDescriptor(STDOUT_FILENO, FileFd::WriteOnly, false);
+  stdoutfd.OpenDescriptor(STDOUT_FILENO, FileFd::WriteOnly | FileFd::BufferedWrite, false);
   auto const Buffer = std::unique_ptr<unsigned char[]>(new unsigned char[Largest + 1]);
+  pkgTagSection Section;
   for (vector<PkgName>::iterator I = List.begin(); I != List.end(); ++I)
   {
     // Read in the Record.
@@ -130,7 +129,7 @@ static bool DoIt(string InFile)
     if (Section.Write(stdoutfd, Order) == false || stdoutfd.Write("\n", 1) == false)
       return _error->Error("Internal error, failed to sort fields");
   }
-  return true;
+  return stdoutfd.Close();
 }
 /*}}}*/
 static bool ShowHelp(CommandLine &) /*{{{*/
@@ -27,6 +27,7 @@
 
 #ifdef HAVE_SECCOMP
 #include <csignal>
+#include <sched.h>
 
 #include <seccomp.h>
 #endif
@@ -209,6 +210,9 @@ class aptMethod : public pkgAcqMethod, public aptConfigWrapperForMethods
     ALLOW(clock_nanosleep);
     ALLOW(clock_nanosleep_time64);
     ALLOW(close);
+#ifdef __NR_copy_file_range
+    ALLOW(copy_file_range);
+#endif
     ALLOW(creat);
     ALLOW(dup);
     ALLOW(dup2);
@@ -341,6 +345,24 @@ class aptMethod : public pkgAcqMethod, public aptConfigWrapperForMethods
     ALLOW(write);
     ALLOW(writev);
 
+    // the inbuilt xz (de)compressor may start threads, but no processes
+    ALLOW(sched_getaffinity);
+#ifdef __NR_rseq
+    ALLOW(rseq);
+#endif
+#if defined(__s390__) || defined(__s390x__)
+    rc = seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(clone), 1, SCMP_A1(SCMP_CMP_MASKED_EQ, CLONE_THREAD, CLONE_THREAD));
+#else
+    rc = seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(clone), 1, SCMP_A0(SCMP_CMP_MASKED_EQ, CLONE_THREAD, CLONE_THREAD));
+#endif
+    if (rc != 0)
+      return _error->FatalE("HttpMethod::Configuration", "Cannot allow %s: %s", "clone", strerror(-rc));
+#ifdef __NR_clone3
+    // its flags can't be checked, so make the C library fall back to clone
+    if ((rc = seccomp_rule_add(ctx, SCMP_ACT_ERRNO(ENOSYS), SCMP_SYS(clone3), 0)))
+      return _error->FatalE("HttpMethod::Configuration", "Cannot deny %s: %s", "clone3", strerror(-rc));
+#endif
+
     if ((SeccompFlags & Seccomp::NETWORK) != 0)
     {
       ALLOW(bind);
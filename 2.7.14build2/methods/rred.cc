@@ -792,7 +792,8 @@ class RredMethod : public aptMethod
                 << std::endl;
 
     FileFd inp, out;
-    if (inp.Open(Path, FileFd::ReadOnly, FileFd::Extension) == false)
+    unsigned int const ReadAhead = ConfigFindB("ReadAhead", false) ? FileFd::ReadAhead : 0;
+    if (inp.Open(Path, FileFd::ReadOnly | ReadAhead, FileFd::Extension) == false)
     {
       if (Debug == true)
         std::clog << "FAILED to open inp " << Path << std::endl;
@@ -914,7 +915,7 @@ int main(int argc, const char *argv[])
     }
     if (not quiet)
       std::clog << "Patching " << CmdL.FileList[0] << " into " << CmdL.FileList[1] << "\n";
-    input.Open(CmdL.FileList[0], FileFd::ReadOnly, FileFd::Extension);
+    input.Open(CmdL.FileList[0], FileFd::ReadOnly | (_config->FindB("Rred::ReadAhead", false) ? FileFd::ReadAhead : 0), FileFd::Extension);
     if (compressor == nullptr)
       output.Open(CmdL.FileList[1], FileFd::WriteOnly | FileFd::Create | FileFd::Empty | FileFd::BufferedWrite, FileFd::Extension);
     else
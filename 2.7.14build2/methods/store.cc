@@ -21,6 +21,7 @@
 #include <apt-pkg/hashes.h>
 #include <apt-pkg/strutl.h>
 
+#include <algorithm>
 #include <cstring>
 #include <string>
 #include <vector>
@@ -55,6 +56,15 @@ static bool OpenFileWithCompressorByName(FileFd &fileFd, std::string const &File
       break;
   if (compressor == compressors.end())
     return _error->Error("Extraction of file %s requires unknown compressor %s", Filename.c_str(), Name.c_str());
+  if ((Mode & FileFd::WriteOnly) == FileFd::WriteOnly && compressor->Name == "xz" &&
+      std::none_of(compressor->CompressArgs.begin(), compressor->CompressArgs.end(), [](std::string const &Arg)
+                   { return APT::String::Startswith(Arg, "--block-size="); }))
+  {
+    // FileFd can seek in a file of small blocks by decoding only one of them
+    APT::Configuration::Compressor seekable = *compressor;
+    seekable.CompressArgs.push_back("--block-size=1MiB");
+    return fileFd.Open(Filename, Mode, seekable);
+  }
   return fileFd.Open(Filename, Mode, *compressor);
 }
 
@@ -72,7 +82,9 @@ bool StoreMethod::Fetch(FetchItem *Itm) /*{{{*/
   FileFd From;
   if (_config->FindB("Method::Compress", false) == false)
   {
-    if (OpenFileWithCompressorByName(From, Path, FileFd::ReadOnly, Binary) == false)
+    // a thread decompressing ahead only pays off for big files on a system with idle cores
+    unsigned int const ReadAhead = ConfigFindB("ReadAhead", false) ? FileFd::ReadAhead : 0;
+    if (OpenFileWithCompressorByName(From, Path, FileFd::ReadOnly | ReadAhead, Binary) == false)
       return false;
     if (From.IsCompressed() && From.FileSize() == 0)
       return _error->Error(_("Empty files can't be valid archives"));
@@ -0,0 +1,107 @@
+/* Usage: hashbench [size…]
+   Compares the speed of the hash backends used by Hashes on inputs of the
+   given sizes (4 KiB, 1 MiB and 256 MiB by default): libgcrypt with the
+   hardware features it detected at runtime (SHA extensions, AVX2, …),
+   libgcrypt restricted to its generic implementations and all algorithms
+   at once hashed in a thread each. libgcrypt can only be configured before it
+   is initialized, so each backend is measured in a process of its own. */
+
+#include <config.h>
+
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/hashes.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+struct Backend
+{
+  char const *Name;
+  char const *DisableHWF;
+  int Threads;
+};
+
+static double Measure(unsigned int const Algo, std::vector<unsigned char> const &Data) /*{{{*/
+{
+  // hash small inputs repeatedly to get a measurable time
+  auto const Start = std::chrono::steady_clock::now();
+  unsigned long long Total = 0;
+  do
+  {
+    Hashes hashes(Algo);
+    hashes.Add(Data.data(), Data.size());
+    hashes.GetHashStringList();
+    Total += Data.size();
+  } while (Total < 256 * 1024 * 1024 && std::chrono::steady_clock::now() - Start < std::chrono::milliseconds(500));
+  std::chrono::duration<double> const Duration = std::chrono::steady_clock::now() - Start;
+  return Total / Duration.count() / 1000 / 1000;
+}
+/*}}}*/
+static void Run(Backend const &B, std::vector<size_t> const &Sizes) /*{{{*/
+{
+  _config->Set("APT::Hashes-DisableHWF", B.DisableHWF);
+  _config->Set("APT::Hashes-Threads", B.Threads);
+  struct
+  {
+    char const *Name;
+    unsigned int Algo;
+  } const Algorithms[] = {
+     {"MD5Sum", Hashes::MD5SUM},
+     {"SHA1", Hashes::SHA1SUM},
+     {"SHA256", Hashes::SHA256SUM},
+     {"SHA512", Hashes::SHA512SUM},
+     {"all", ~0u},
+  };
+  for (auto const Size : Sizes)
+  {
+    std::vector<unsigned char> Data(Size);
+    unsigned int x = 42;
+    for (auto &c : Data)
+    {
+      x = x * 1103515245 + 12345;
+      c = x >> 16;
+    }
+    for (auto const &A : Algorithms)
+    {
+      // threads only make a difference for several algorithms
+      if (B.Threads > 1 && A.Algo != ~0u)
+        continue;
+      printf("%-28s %-8s %10zu bytes %8.1f MB/s\n", B.Name, A.Name, Size, Measure(A.Algo, Data));
+      fflush(stdout);
+    }
+  }
+}
+/*}}}*/
+int main(int argc, char *argv[]) /*{{{*/
+{
+  std::vector<size_t> Sizes;
+  for (int i = 1; i < argc; ++i)
+    Sizes.push_back(strtoull(argv[i], nullptr, 10));
+  if (Sizes.empty())
+    Sizes = {4 * 1024, 1024 * 1024, 256 * 1024 * 1024};
+
+  Backend const Backends[] = {
+     {"gcrypt (hardware)", "", 1},
+     {"gcrypt (generic)", "all", 1},
+     {"gcrypt (hardware, threads)", "", 4},
+  };
+  for (auto const &B : Backends)
+  {
+    pid_t const Child = fork();
+    if (Child == 0)
+    {
+      Run(B, Sizes);
+      _exit(0);
+    }
+    int Status;
+    if (Child < 0 || waitpid(Child, &Status, 0) != Child || WIFEXITED(Status) == false || WEXITSTATUS(Status) != 0)
+      return 1;
+  }
+  return 0;
+}
+/*}}}*/
@@ -12,6 +12,8 @@
 #include <string>
 #include <vector>
 
+#include <sys/uio.h>
+
 #include <gtest/gtest.h>
 
 #include "file-helpers.h"
@@ -224,6 +226,362 @@ TEST(FileUtlTest, FileFD)
   EXPECT_EQ(0, chdir(startdir.c_str()));
   removeDirectory(tempdir);
 }
+static void TestVectoredWrite(unsigned int const filemode, std::string const &compressor)
+{
+  SCOPED_TRACE(compressor);
+  SCOPED_TRACE(filemode);
+  auto const file = createTemporaryFile("filefd-writev");
+  // more pieces than a single writev call accepts, some of them empty
+  std::string expected;
+  std::vector<std::string> pieces;
+  for (unsigned int i = 0; i < 3000; ++i)
+  {
+    std::string piece;
+    if (i % 7 != 0)
+      strprintf(piece, "piece %u\n", i);
+    pieces.push_back(piece);
+    expected.append(piece);
+  }
+  std::vector<struct iovec> vec;
+  for (auto &piece : pieces)
+    vec.push_back({&piece[0], piece.length()});
+
+  FileFd f;
+  auto const compressors = APT::Configuration::getCompressors();
+  auto const c = std::find_if(compressors.begin(), compressors.end(), [&](APT::Configuration::Compressor const &c)
+                              { return c.Name == compressor; });
+  ASSERT_NE(compressors.end(), c);
+  ASSERT_TRUE(f.Open(file.Name(), filemode, *c));
+  EXPECT_TRUE(f.Write(vec.data(), vec.size()));
+  EXPECT_EQ(expected.length(), f.Tell());
+  EXPECT_TRUE(f.Close());
+
+  ASSERT_TRUE(f.Open(file.Name(), FileFd::ReadOnly, *c));
+  std::string written(expected.length(), '\0');
+  EXPECT_TRUE(f.Read(&written[0], written.length()));
+  EXPECT_EQ(expected, written);
+  char c2;
+  unsigned long long actual;
+  EXPECT_TRUE(f.Read(&c2, 1, &actual));
+  EXPECT_EQ(0u, actual);
+}
+TEST(FileUtlTest, VectoredWrite)
+{
+  for (auto const &compressor : {".", "gzip"})
+  {
+    TestVectoredWrite(FileFd::WriteOnly | FileFd::Create | FileFd::Empty, compressor);
+    TestVectoredWrite(FileFd::WriteOnly | FileFd::Create | FileFd::Empty | FileFd::BufferedWrite, compressor);
+  }
+}
+static std::string ReadWholeFile(std::string const &filename, APT::Configuration::Compressor const &compressor)
+{
+  FileFd fd;
+  EXPECT_TRUE(fd.Open(filename, FileFd::ReadOnly, compressor));
+  std::string content;
+  char buffer[4096];
+  unsigned long long actual;
+  while (fd.Read(buffer, sizeof(buffer), &actual) && actual != 0)
+    content.append(buffer, actual);
+  return content;
+}
+TEST(FileUtlTest, CopyFile)
+{
+  std::string expected;
+  for (unsigned int i = 0; i < 50000; ++i)
+    expected.append("Package: pkg").append(std::to_string(i)).append("\n\n");
+  auto const source = createTemporaryFile("copyfrom", expected.c_str());
+  auto const compressors = APT::Configuration::getCompressors();
+  auto const uncompressed = *std::find_if(compressors.begin(), compressors.end(), [](APT::Configuration::Compressor const &c)
+                                          { return c.Name == "."; });
+  auto const gzip = std::find_if(compressors.begin(), compressors.end(), [](APT::Configuration::Compressor const &c)
+                                 { return c.Name == "gzip"; });
+
+  // whole files are shared or copied by the kernel if possible
+  for (int const mode : {FileFd::WriteAtomic | 0, FileFd::WriteOnly | FileFd::Create | FileFd::Empty | FileFd::BufferedWrite})
+  {
+    SCOPED_TRACE(mode);
+    auto const target = createTemporaryFile("copyto");
+    FileFd From(source.Name(), FileFd::ReadOnly);
+    FileFd To(target.Name(), mode);
+    EXPECT_TRUE(CopyFile(From, To));
+    EXPECT_EQ(expected.length(), From.Tell());
+    EXPECT_EQ(expected.length(), To.Tell());
+    EXPECT_TRUE(To.Write("end\n", 4));
+    EXPECT_TRUE(To.Close());
+    EXPECT_EQ(expected + "end\n", ReadWholeFile(target.Name(), uncompressed));
+  }
+
+  // the rest of a partly read file is appended
+  {
+    auto const target = createTemporaryFile("copyto", "start\n");
+    FileFd From(source.Name(), FileFd::ReadOnly);
+    char line[100];
+    ASSERT_TRUE(From.ReadLine(line, sizeof(line)));
+    FileFd To(target.Name(), FileFd::WriteOnly);
+    ASSERT_TRUE(To.Seek(6));
+    EXPECT_TRUE(CopyFile(From, To));
+    EXPECT_TRUE(To.Close());
+    EXPECT_EQ("start\n" + expected.substr(strlen(line)), ReadWholeFile(target.Name(), uncompressed));
+  }
+
+  // compressed files are copied through userspace
+  if (gzip != compressors.end())
+  {
+    auto const target = createTemporaryFile("copyto");
+    FileFd From(source.Name(), FileFd::ReadOnly);
+    FileFd To;
+    ASSERT_TRUE(To.Open(target.Name(), FileFd::WriteOnly | FileFd::Create | FileFd::Empty, *gzip));
+    EXPECT_TRUE(CopyFile(From, To));
+    EXPECT_TRUE(To.Close());
+    EXPECT_EQ(expected, ReadWholeFile(target.Name(), *gzip));
+  }
+}
+// about 1.7 MB of stanzas, enough for a few blocks or chunks
+static std::string PackagesStanzas()
+{
+  std::string stanzas;
+  for (unsigned int i = 0; i < 50000; ++i)
+  {
+    std::string stanza;
+    strprintf(stanza, "Package: pkg%u\nVersion: %u\n\n", i, i * 7);
+    stanzas.append(stanza);
+  }
+  return stanzas;
+}
+static void TestMultiBlockXz(std::string const &filename, std::string const &threads, std::string const &expected)
+{
+  SCOPED_TRACE(threads);
+  _config->Clear("APT::Compressor::xz::UncompressArg");
+  _config->Set("APT::Compressor::xz::UncompressArg::", "-d");
+  _config->Set("APT::Compressor::xz::UncompressArg::", threads);
+  FileFd f;
+  ASSERT_TRUE(f.Open(filename, FileFd::ReadOnly, FileFd::Xz));
+  std::string content(expected.length(), '\0');
+  EXPECT_TRUE(f.Read(&content[0], content.length()));
+  EXPECT_EQ(expected, content);
+  char c;
+  unsigned long long actual;
+  EXPECT_TRUE(f.Read(&c, 1, &actual));
+  EXPECT_EQ(0u, actual);
+  EXPECT_TRUE(f.Close());
+}
+TEST(FileUtlTest, MultiBlockXz)
+{
+  std::string const expected = PackagesStanzas();
+  auto const plain = createTemporaryFile("multiblock", expected.c_str());
+  auto const xz = createTemporaryFile("multiblockxz");
+  if (system(("xz -T2 --block-size=64KiB -c " + plain.Name() + " > " + xz.Name() + " 2>/dev/null").c_str()) != 0)
+    GTEST_SKIP() << "xz is not available";
+
+  TestMultiBlockXz(xz.Name(), "-T1", expected);
+  TestMultiBlockXz(xz.Name(), "-T4", expected);
+  TestMultiBlockXz(xz.Name(), "--threads=0", expected);
+  _config->Clear("APT::Compressor::xz::UncompressArg");
+}
+TEST(FileUtlTest, ThreadedCompression)
+{
+  std::string const expected = PackagesStanzas();
+  for (auto const name : {"xz", "zstd"})
+  {
+    SCOPED_TRACE(name);
+    std::string const config = std::string("APT::Compressor::") + name + "::CompressArg";
+    _config->Set(config + "::", "-3");
+    _config->Set(config + "::", "-T2");
+    _config->Set(config + "::", "--block-size=64KiB");
+    auto const compressors = APT::Configuration::getCompressors();
+    auto const compressor = std::find_if(compressors.begin(), compressors.end(), [&](APT::Configuration::Compressor const &c)
+                                         { return c.Name == name; });
+    if (compressor == compressors.end())
+    {
+      _config->Clear(config);
+      continue;
+    }
+    auto const file = createTemporaryFile("threadedcompression");
+    FileFd f;
+    ASSERT_TRUE(f.Open(file.Name(), FileFd::WriteOnly | FileFd::Create | FileFd::Empty, *compressor));
+    EXPECT_TRUE(f.Write(expected.c_str(), expected.length()));
+    EXPECT_TRUE(f.Close());
+    _config->Clear(config);
+
+    if (compressor->Name == "xz")
+    {
+      TestMultiBlockXz(file.Name(), "-T1", expected);
+      TestMultiBlockXz(file.Name(), "-T4", expected);
+      _config->Clear("APT::Compressor::xz::UncompressArg");
+    }
+    else
+    {
+      ASSERT_TRUE(f.Open(file.Name(), FileFd::ReadOnly, *compressor));
+      std::string content(expected.length(), '\0');
+      EXPECT_TRUE(f.Read(&content[0], content.length()));
+      EXPECT_EQ(expected, content);
+    }
+  }
+}
+TEST(FileUtlTest, SeekInMultiBlockXz)
+{
+  std::string const expected = PackagesStanzas();
+  for (auto const blocksize : {"--block-size=16KiB", "-6"})
+  {
+    SCOPED_TRACE(blocksize);
+    _config->Set("APT::Compressor::xz::CompressArg::", blocksize);
+    auto const compressors = APT::Configuration::getCompressors();
+    _config->Clear("APT::Compressor::xz::CompressArg");
+    auto const compressor = std::find_if(compressors.begin(), compressors.end(), [](APT::Configuration::Compressor const &c)
+                                         { return c.Name == "xz"; });
+    if (compressor == compressors.end())
+      return;
+    auto const file = createTemporaryFile("seekxz");
+    FileFd f;
+    ASSERT_TRUE(f.Open(file.Name(), FileFd::WriteOnly | FileFd::Create | FileFd::Empty, *compressor));
+    EXPECT_TRUE(f.Write(expected.c_str(), expected.length()));
+    EXPECT_TRUE(f.Close());
+
+    ASSERT_TRUE(f.Open(file.Name(), FileFd::ReadOnly, *compressor));
+    char buffer[100];
+    for (auto const offset : {500000ull, 1000ull, 16384ull, 16383ull, 16400ull, 700000ull, 0ull, static_cast<unsigned long long>(expected.length() - 10)})
+    {
+      SCOPED_TRACE(offset);
+      ASSERT_TRUE(f.Seek(offset));
+      EXPECT_EQ(offset, f.Tell());
+      unsigned long long actual;
+      ASSERT_TRUE(f.Read(buffer, sizeof(buffer), &actual));
+      EXPECT_EQ(std::min(sizeof(buffer), static_cast<size_t>(expected.length() - offset)), actual);
+      EXPECT_EQ(expected.substr(offset, actual), std::string(buffer, actual));
+      EXPECT_EQ(offset + actual, f.Tell());
+    }
+    // reading on continues over the end of a block
+    ASSERT_TRUE(f.Seek(16000));
+    std::string content(expected.length() - 16000, '\0');
+    EXPECT_TRUE(f.Read(&content[0], content.length()));
+    EXPECT_EQ(expected.substr(16000), content);
+    unsigned long long actual;
+    EXPECT_TRUE(f.Read(buffer, 1, &actual));
+    EXPECT_EQ(0u, actual);
+    EXPECT_EQ(expected.length(), f.Size());
+  }
+}
+TEST(FileUtlTest, SeekInLz4Frames)
+{
+  std::string const expected = PackagesStanzas();
+  auto const compressors = APT::Configuration::getCompressors();
+  auto const compressor = std::find_if(compressors.begin(), compressors.end(), [](APT::Configuration::Compressor const &c)
+                                       { return c.Name == "lz4"; });
+  if (compressor == compressors.end())
+    return;
+  auto const file = createTemporaryFile("seeklz4");
+  FileFd f;
+
+  // by default the file is one frame, which older decoders read completely
+  ASSERT_TRUE(f.Open(file.Name(), FileFd::WriteOnly | FileFd::Create | FileFd::Empty, *compressor));
+  EXPECT_TRUE(f.Write(expected.c_str(), expected.length()));
+  EXPECT_TRUE(f.Close());
+  std::string frames;
+  ASSERT_TRUE(f.Open(file.Name(), FileFd::ReadOnly, FileFd::None));
+  frames.resize(f.Size());
+  EXPECT_TRUE(f.Read(&frames[0], frames.length()));
+  EXPECT_TRUE(f.Close());
+  ASSERT_LT(4u, frames.length());
+  // a streamed frame has no content size in its header
+  EXPECT_EQ(0, frames[4] & 0x08);
+
+  APT::Configuration::Compressor framed = *compressor;
+  framed.CompressArgs.push_back("--block-size=1MiB");
+  ASSERT_TRUE(f.Open(file.Name(), FileFd::WriteOnly | FileFd::Create | FileFd::Empty, framed));
+  EXPECT_TRUE(f.Write(expected.c_str(), expected.length()));
+  EXPECT_TRUE(f.Close());
+
+  // every frame is read, not only the first one
+  ASSERT_TRUE(f.Open(file.Name(), FileFd::ReadOnly, *compressor));
+  std::string content(expected.length(), '\0');
+  EXPECT_TRUE(f.Read(&content[0], content.length()));
+  EXPECT_EQ(expected, content);
+  char buffer[100];
+  unsigned long long actual;
+  EXPECT_TRUE(f.Read(buffer, 1, &actual));
+  EXPECT_EQ(0u, actual);
+
+  for (auto const offset : {1500000ull, 1000ull, 1048576ull, 1048575ull, 1048600ull, 700000ull, 0ull, static_cast<unsigned long long>(expected.length() - 10)})
+  {
+    SCOPED_TRACE(offset);
+    ASSERT_TRUE(f.Seek(offset));
+    EXPECT_EQ(offset, f.Tell());
+    ASSERT_TRUE(f.Read(buffer, sizeof(buffer), &actual));
+    EXPECT_EQ(std::min(sizeof(buffer), static_cast<size_t>(expected.length() - offset)), actual);
+    EXPECT_EQ(expected.substr(offset, actual), std::string(buffer, actual));
+    EXPECT_EQ(offset + actual, f.Tell());
+  }
+  EXPECT_TRUE(f.Close());
+
+  // an empty file is a valid lz4 file, too
+  ASSERT_TRUE(f.Open(file.Name(), FileFd::WriteOnly | FileFd::Create | FileFd::Empty, framed));
+  EXPECT_TRUE(f.Close());
+  ASSERT_TRUE(f.Open(file.Name(), FileFd::ReadOnly, *compressor));
+  EXPECT_TRUE(f.Read(buffer, sizeof(buffer), &actual));
+  EXPECT_EQ(0u, actual);
+}
+TEST(FileUtlTest, ReadAhead)
+{
+  std::string const expected = PackagesStanzas();
+  // only the compressors built into the library decompress ahead
+  std::vector<std::string> inbuilt;
+#ifdef HAVE_ZLIB
+  inbuilt.push_back("gzip");
+#endif
+#ifdef HAVE_BZ2
+  inbuilt.push_back("bzip2");
+#endif
+#ifdef HAVE_LZMA
+  inbuilt.push_back("xz");
+  inbuilt.push_back("lzma");
+#endif
+#ifdef HAVE_LZ4
+  inbuilt.push_back("lz4");
+#endif
+#ifdef HAVE_ZSTD
+  inbuilt.push_back("zstd");
+#endif
+  for (auto const &compressor : APT::Configuration::getCompressors())
+  {
+    if (std::find(inbuilt.begin(), inbuilt.end(), compressor.Name) == inbuilt.end())
+      continue;
+    SCOPED_TRACE(compressor.Name);
+    auto const file = createTemporaryFile("readahead");
+    FileFd f;
+    ASSERT_TRUE(f.Open(file.Name(), FileFd::WriteOnly | FileFd::Create | FileFd::Empty | FileFd::ReadAhead, compressor));
+    EXPECT_TRUE(f.Write(expected.c_str(), expected.length()));
+    EXPECT_TRUE(f.Close());
+
+    ASSERT_TRUE(f.Open(file.Name(), FileFd::ReadOnly | FileFd::ReadAhead, compressor));
+    char line[100];
+    ASSERT_TRUE(f.ReadLine(line, sizeof(line)));
+    EXPECT_STREQ("Package: pkg0\n", line);
+    EXPECT_EQ(14u, f.Tell());
+    // the size is known without losing the position
+    EXPECT_EQ(expected.length(), f.Size());
+    EXPECT_EQ(14u, f.Tell());
+    std::string content(expected.length() - 14, '\0');
+    EXPECT_TRUE(f.Read(&content[0], content.length()));
+    EXPECT_EQ(expected.substr(14), content);
+    unsigned long long actual;
+    EXPECT_TRUE(f.Read(line, 1, &actual));
+    EXPECT_EQ(0u, actual);
+    EXPECT_TRUE(f.Eof());
+
+    for (auto const offset : {1000ull, 500000ull, 400000ull, 400100ull, 0ull})
+    {
+      SCOPED_TRACE(offset);
+      ASSERT_TRUE(f.Seek(offset));
+      EXPECT_EQ(offset, f.Tell());
+      ASSERT_TRUE(f.Read(line, sizeof(line), &actual));
+      EXPECT_EQ(sizeof(line), actual);
+      EXPECT_EQ(expected.substr(offset, actual), std::string(line, actual));
+      EXPECT_EQ(offset + actual, f.Tell());
+    }
+    EXPECT_TRUE(f.Close());
+    EXPECT_FALSE(_error->PendingError());
+  }
+}
 TEST(FileUtlTest, Glob)
 {
   std::vector<std::string> files;
@@ -5,6 +5,7 @@
 #include <apt-pkg/hashes.h>
 #include <apt-pkg/strutl.h>
 
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
 #include <string>
@@ -302,3 +303,57 @@ TEST(HashSumsTest, HashStringList)
 
   _config->Clear("Acquire::ForceHash");
 }
+TEST(HashSumsTest, Threads)
+{
+  // big enough to pass through the ring of chunks several times
+  std::string data;
+  data.reserve(3 * 1024 * 1024 + 12345);
+  unsigned int x = 42;
+  while (data.size() != data.capacity())
+  {
+    x = x * 1103515245 + 12345;
+    data.push_back(static_cast<char>(x >> 16));
+  }
+  FileFd fd;
+  openTemporaryFile("hashsums-threads", fd);
+  ASSERT_TRUE(fd.Write(data.c_str(), data.size()));
+
+  _config->Set("APT::Hashes-Threads", 1);
+  Hashes expected;
+  expected.Add(data.c_str(), data.size());
+  HashStringList const list = expected.GetHashStringList();
+  EXPECT_EQ(5u, list.size());
+  EXPECT_EQ(data.size(), list.FileSize());
+
+  for (int const threads : {2, 3, 4})
+  {
+    SCOPED_TRACE(threads);
+    _config->Set("APT::Hashes-Threads", threads);
+    {
+      Hashes hashes;
+      for (size_t i = 0; i < data.size(); i += 7777)
+        hashes.Add(data.c_str() + i, std::min<size_t>(7777, data.size() - i));
+      HashStringList const threaded = hashes.GetHashStringList();
+      EXPECT_EQ(5u, threaded.size());
+      EXPECT_EQ(list, threaded);
+      for (auto const &hs : list)
+        EXPECT_EQ(hs, *threaded.find(hs.HashType()));
+    }
+    {
+      ASSERT_TRUE(fd.Seek(0));
+      Hashes hashes(Hashes::SHA256SUM | Hashes::SHA512SUM);
+      EXPECT_TRUE(hashes.AddFD(fd));
+      EXPECT_EQ(*list.find("SHA256"), hashes.GetHashString(Hashes::SHA256SUM));
+      EXPECT_EQ(*list.find("SHA512"), hashes.GetHashString(Hashes::SHA512SUM));
+    }
+    {
+      // small inputs don't start any thread, but are hashed the same
+      Hashes hashes;
+      hashes.Add("The quick brown fox jumps over the lazy dog");
+      HashStringList const small = hashes.GetHashStringList();
+      EXPECT_EQ("9e107d9d372bb6826bd81d3542a419d6", small.find("MD5Sum")->HashValue());
+      EXPECT_EQ("2fd4e1c67a2d28fced849ee1bb76e7391b93eb12", small.find("SHA1")->HashValue());
+    }
+  }
+  _config->Clear("APT::Hashes-Threads");
+}
@@ -0,0 +1,111 @@
+#include <config.h>
+
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/error.h>
+#include <apt-pkg/fileutl.h>
+#include <apt-pkg/mmap.h>
+#include <apt-pkg/pkgcache.h>
+#include <apt-pkg/pkgcachegen.h>
+#include <apt-pkg/pkgsystem.h>
+#include <apt-pkg/sourcelist.h>
+#include <apt-pkg/strutl.h>
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "file-helpers.h"
+
+static void WriteFile(std::string const &name, std::string const &content)
+{
+  FileFd fd(name, FileFd::WriteOnly | FileFd::Create | FileFd::Empty);
+  ASSERT_TRUE(fd.Write(content.c_str(), content.length()));
+  ASSERT_TRUE(fd.Close());
+}
+static std::string ReadFile(std::string const &name)
+{
+  FileFd fd(name, FileFd::ReadOnly);
+  std::string content(fd.Size(), '\0');
+  EXPECT_TRUE(fd.Read(&content[0], content.size()));
+  return content;
+}
+static void SetupCacheDirectory(std::string const &tempdir)
+{
+  std::string const repo = tempdir + "/repo/";
+  std::string const lists = tempdir + "/lists/";
+  ASSERT_TRUE(CreateDirectory(tempdir, repo));
+  ASSERT_TRUE(CreateDirectory(tempdir, lists));
+  ASSERT_NO_FATAL_FAILURE(WriteFile(tempdir + "/sources.list", "deb [trusted=yes] file:" + repo + " ./\n"));
+  ASSERT_NO_FATAL_FAILURE(WriteFile(lists + URItoFileName("file:" + repo + "./Packages"),
+                                    "Package: foo\nArchitecture: all\nVersion: 1\nDescription: foo\n"));
+  ASSERT_NO_FATAL_FAILURE(WriteFile(tempdir + "/status",
+                                    "Package: bar\nStatus: install ok installed\nArchitecture: all\nVersion: 1\nDescription: bar\n"));
+
+  _config->Set("Acquire::IndexTargets::deb::Packages::MetaKey", "$(COMPONENT)/binary-$(ARCHITECTURE)/Packages");
+  _config->Set("Acquire::IndexTargets::deb::Packages::flatMetaKey", "Packages");
+  _config->Set("Acquire::IndexTargets::deb::Packages::ShortDescription", "Packages");
+  _config->Set("Acquire::IndexTargets::deb::Packages::Description", "$(RELEASE)/$(COMPONENT) $(ARCHITECTURE) Packages");
+  _config->Set("Acquire::IndexTargets::deb::Packages::flatDescription", "$(RELEASE) Packages");
+  _config->Set("Dir::Etc::sourcelist", tempdir + "/sources.list");
+  _config->Set("Dir::Etc::sourceparts", "/nonexistent");
+  _config->Set("Dir::State::lists", lists);
+  _config->Set("Dir::State::status", tempdir + "/status");
+  // only the source cache is stored, so the status is always merged into it
+  _config->Set("Dir::Cache::pkgcache", "");
+  _config->Set("Dir::Cache::srcpkgcache", tempdir + "/srcpkgcache.bin");
+  // forget the status file of a previous test
+  ASSERT_TRUE(_system->Initialize(*_config));
+}
+static void BuildCache(bool &foo, bool &bar)
+{
+  pkgSourceList List;
+  ASSERT_TRUE(List.ReadMainList());
+  MMap *Map = nullptr;
+  ASSERT_TRUE(pkgCacheGenerator::MakeStatusCache(List, nullptr, &Map, true));
+  ASSERT_NE(nullptr, Map);
+  {
+    pkgCache Cache(Map);
+    foo = Cache.FindPkg("foo").end() == false;
+    bar = Cache.FindPkg("bar").end() == false;
+  }
+  delete Map;
+}
+static void LoadedCacheStaysUnchanged(std::string const &id)
+{
+  std::string const status = _config->Find("Dir::State::status");
+  std::string tempdir;
+  createTemporaryDirectory(id, tempdir);
+  ASSERT_NO_FATAL_FAILURE(SetupCacheDirectory(tempdir));
+
+  bool foo = false, bar = false;
+  ASSERT_NO_FATAL_FAILURE(BuildCache(foo, bar));
+  EXPECT_TRUE(foo);
+  EXPECT_TRUE(bar);
+  std::string const srcpkgcache = ReadFile(tempdir + "/srcpkgcache.bin");
+  ASSERT_FALSE(srcpkgcache.empty());
+
+  // the status is merged into the loaded source cache, which isn't changed by it
+  foo = bar = false;
+  ASSERT_NO_FATAL_FAILURE(BuildCache(foo, bar));
+  EXPECT_TRUE(foo);
+  EXPECT_TRUE(bar);
+  EXPECT_EQ(srcpkgcache, ReadFile(tempdir + "/srcpkgcache.bin"));
+  EXPECT_TRUE(_error->empty());
+
+  removeDirectory(tempdir);
+  _config->Set("Dir::State::status", status);
+  EXPECT_TRUE(_system->Initialize(*_config));
+}
+
+TEST(MMapTest, LoadFile)
+{
+  _config->Set("APT::Cache-Fallback", false);
+  LoadedCacheStaysUnchanged("loadfile");
+}
+
+TEST(MMapTest, LoadFileFallback)
+{
+  _config->Set("APT::Cache-Fallback", true);
+  LoadedCacheStaysUnchanged("loadfilefallback");
+  _config->Set("APT::Cache-Fallback", false);
+}
@@ -0,0 +1,140 @@
+#include <config.h>
+
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/error.h>
+#include <apt-pkg/fileutl.h>
+#include <apt-pkg/mmap.h>
+#include <apt-pkg/pkgcachegen.h>
+#include <apt-pkg/sourcelist.h>
+#include <apt-pkg/strutl.h>
+
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "file-helpers.h"
+
+/* Only the allocations of the thread building the cache are counted, and
+   only while it does, so everything else uses operator new as usual. */
+static thread_local unsigned long *Allocations = nullptr;
+
+void *operator new(std::size_t size)
+{
+  if (Allocations != nullptr)
+    ++*Allocations;
+  if (size == 0)
+    size = 1;
+  while (true)
+  {
+    void *const p = std::malloc(size);
+    if (p != nullptr)
+      return p;
+    std::new_handler const handler = std::get_new_handler();
+    if (handler == nullptr)
+      throw std::bad_alloc();
+    handler();
+  }
+}
+void operator delete(void *p) noexcept
+{
+  std::free(p);
+}
+void operator delete(void *p, std::size_t) noexcept
+{
+  std::free(p);
+}
+
+static void WritePackages(std::string const &tempdir, unsigned int const count)
+{
+  std::string const repo = tempdir + "/repo/";
+  std::string const lists = tempdir + "/lists/";
+  ASSERT_TRUE(CreateDirectory(tempdir, repo));
+  ASSERT_TRUE(CreateDirectory(tempdir, lists));
+
+  FileFd sources(tempdir + "/sources.list", FileFd::WriteOnly | FileFd::Create | FileFd::Empty);
+  std::string const line = "deb [trusted=yes] file:" + repo + " ./\n";
+  ASSERT_TRUE(sources.Write(line.c_str(), line.length()));
+  ASSERT_TRUE(sources.Close());
+
+  FileFd packages(lists + URItoFileName("file:" + repo + "./Packages"), FileFd::WriteOnly | FileFd::Create | FileFd::Empty);
+  for (unsigned int i = 0; i < count; ++i)
+  {
+    std::string stanza;
+    strprintf(stanza, "Package: pkg%u\n"
+                      "Architecture: all\n"
+                      "Version: 1.0-1\n"
+                      "Priority: optional\n"
+                      "Section: misc\n"
+                      "Installed-Size: 10\n"
+                      "Size: 1000\n"
+                      "Depends: libc6 (>= 2.36), pkg-common | pkg-alternative\n"
+                      "Recommends: pkg-recommended\n"
+                      "Provides: pkg-virtual (= 1.0)\n"
+                      "Description: test package\n"
+                      "Description-md5: 0123456789abcdef0123456789abcdef\n"
+                      "\n",
+              i);
+    ASSERT_TRUE(packages.Write(stanza.c_str(), stanza.length()));
+  }
+  ASSERT_TRUE(packages.Close());
+}
+
+static void CacheAllocations(std::string const &tempdir, unsigned long &allocations)
+{
+  _config->Set("Dir::State::lists", tempdir + "/lists/");
+  pkgSourceList List;
+  ASSERT_TRUE(List.ReadMainList());
+
+  MMap *Map = nullptr;
+  allocations = 0;
+  Allocations = &allocations;
+  bool const built = pkgCacheGenerator::MakeStatusCache(List, nullptr, &Map, true);
+  Allocations = nullptr;
+  EXPECT_TRUE(built);
+  ASSERT_NE(nullptr, Map);
+  // the packages of the list are in the cache
+  pkgCache Cache(Map);
+  EXPECT_FALSE(Cache.FindPkg("pkg0").end());
+  delete Map;
+}
+
+TEST(CacheGeneratorTest, NoAllocationsPerStanza)
+{
+  std::string small, large;
+  createTemporaryDirectory("cachegensmall", small);
+  createTemporaryDirectory("cachegenlarge", large);
+  ASSERT_NO_FATAL_FAILURE(WritePackages(small, 100));
+  ASSERT_NO_FATAL_FAILURE(WritePackages(large, 200));
+
+  _config->Set("Acquire::IndexTargets::deb::Packages::MetaKey", "$(COMPONENT)/binary-$(ARCHITECTURE)/Packages");
+  _config->Set("Acquire::IndexTargets::deb::Packages::flatMetaKey", "Packages");
+  _config->Set("Acquire::IndexTargets::deb::Packages::ShortDescription", "Packages");
+  _config->Set("Acquire::IndexTargets::deb::Packages::Description", "$(RELEASE)/$(COMPONENT) $(ARCHITECTURE) Packages");
+  _config->Set("Acquire::IndexTargets::deb::Packages::flatDescription", "$(RELEASE) Packages");
+  _config->Set("Dir::Etc::sourcelist", small + "/sources.list");
+  _config->Set("Dir::Etc::sourceparts", "/nonexistent");
+  _config->Set("Dir::State::status", "/nonexistent");
+  _config->Set("Dir::Cache::pkgcache", "");
+  _config->Set("Dir::Cache::srcpkgcache", "");
+  // everything is done by the calling thread
+  std::string const threads = _config->Find("APT::Cache-Threads");
+  _config->Set("APT::Cache-Threads", 1);
+
+  // the first run sets up everything which is done only once
+  unsigned long warmup, allocSmall, allocLarge;
+  ASSERT_NO_FATAL_FAILURE(CacheAllocations(small, warmup));
+  ASSERT_NO_FATAL_FAILURE(CacheAllocations(small, allocSmall));
+  _config->Set("Dir::Etc::sourcelist", large + "/sources.list");
+  ASSERT_NO_FATAL_FAILURE(CacheAllocations(large, allocLarge));
+  EXPECT_EQ(allocSmall, allocLarge);
+  EXPECT_TRUE(_error->empty());
+  if (threads.empty())
+    _config->Clear("APT::Cache-Threads");
+  else
+    _config->Set("APT::Cache-Threads", threads);
+
+  removeDirectory(small);
+  removeDirectory(large);
+}
@@ -1,13 +1,18 @@
 #include <config.h>
 
+#include <apt-pkg/error.h>
 #include <apt-pkg/fileutl.h>
 #include <apt-pkg/tagfile.h>
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
+#include <mutex>
 #include <sstream>
 #include <string>
 #include <unistd.h>
+#include <utility>
+#include <vector>
 
 #include <gtest/gtest.h>
 
@@ -226,6 +231,205 @@ TEST(TagFileTest, SpacesEverywhere)
   EXPECT_EQ(12u, section.Count());
 }
 
+TEST(TagFileTest, LinesAcrossBlocks)
+{
+  // the scanner looks at 64 bytes at a time, so let lines end everywhere in them
+  std::string content;
+  for (size_t i = 0; i < 150; ++i)
+  {
+    content.append("Field").append(std::to_string(i)).append(": ").append(std::string(i, 'a')).append("\n");
+    if (i % 7 == 6)
+      content.append(" ").append(std::string(i, 'b')).append("\n");
+  }
+  content.append("Last:").append(std::string(63, 'c')).append("\n\n");
+
+  pkgTagSection section;
+  ASSERT_TRUE(section.Scan(content.c_str(), content.size()));
+  EXPECT_EQ(151u, section.Count());
+  EXPECT_EQ(content.size(), section.size());
+  for (size_t i = 0; i < 150; ++i)
+  {
+    std::string value(i, 'a');
+    if (i % 7 == 6)
+      value.append("\n ").append(std::string(i, 'b'));
+    EXPECT_EQ(value, section.FindS("Field" + std::to_string(i))) << i;
+  }
+  EXPECT_EQ(std::string(63, 'c'), section.FindS("Last"));
+
+  // without the empty line the section is incomplete
+  EXPECT_FALSE(section.Scan(content.c_str(), content.size() - 1));
+}
+
+TEST(TagFileTest, BlanksAcrossBlocks)
+{
+  // values start after and continue on lines starting with blanks anywhere in the blocks
+  std::string content;
+  for (size_t i = 0; i < 130; ++i)
+  {
+    content.append("Field").append(std::to_string(i)).append(":").append(std::string(i, i % 2 == 0 ? ' ' : '\t'));
+    content.append("v").append(std::to_string(i)).append("\n");
+    content.append(i % 3 == 0 ? "\t" : " ").append(std::string(i + 1, 'c')).append("\n");
+  }
+  content.append("\n");
+
+  pkgTagSection section;
+  ASSERT_TRUE(section.Scan(content.c_str(), content.size()));
+  EXPECT_EQ(130u, section.Count());
+  for (size_t i = 0; i < 130; ++i)
+  {
+    std::string value = "v" + std::to_string(i) + "\n";
+    value.append(i % 3 == 0 ? "\t" : " ").append(std::string(i + 1, 'c'));
+    EXPECT_EQ(value, section.FindS("Field" + std::to_string(i))) << i;
+  }
+}
+
+TEST(TagFileTest, MappedFile)
+{
+  FileFd fd;
+  openTemporaryFile("mappedfile", fd, "Package: pkgA\n"
+                                      "Version: 1\n"
+                                      "\n"
+                                      "Package: pkgB\n"
+                                      "Description: bbb\n"
+                                      " bbb\n"
+                                      "\n"
+                                      "Package: pkgC\n"
+                                      "Version: 3");
+
+  // the mapped file is split into the same sections at the same offsets
+  std::vector<unsigned long> offsets;
+  std::vector<std::string> packages;
+  {
+    pkgTagFile tfile(&fd);
+    pkgTagSection section;
+    offsets.push_back(tfile.Offset());
+    while (tfile.Step(section))
+    {
+      packages.push_back(section.FindS("Package"));
+      offsets.push_back(tfile.Offset());
+    }
+  }
+  ASSERT_EQ(3u, packages.size());
+  ASSERT_TRUE(fd.Seek(0));
+
+  pkgTagFile tfile(&fd, pkgTagFile::MMAP);
+  pkgTagSection section;
+  EXPECT_EQ(offsets[0], tfile.Offset());
+  for (size_t i = 0; i < packages.size(); ++i)
+  {
+    ASSERT_TRUE(tfile.Step(section));
+    EXPECT_EQ(packages[i], section.FindS("Package"));
+    EXPECT_EQ(offsets[i + 1], tfile.Offset());
+  }
+  EXPECT_EQ("3", section.FindS("Version"));
+  EXPECT_FALSE(tfile.Step(section));
+  // … without reading the file
+  EXPECT_EQ(0u, fd.Tell());
+
+  // jumping back into the map works after the end was copied
+  ASSERT_TRUE(tfile.Jump(section, offsets[1]));
+  EXPECT_EQ("pkgB", section.FindS("Package"));
+  EXPECT_EQ("bbb\n bbb", section.FindS("Description"));
+  ASSERT_TRUE(tfile.Jump(section, offsets[2]));
+  EXPECT_EQ("pkgC", section.FindS("Package"));
+  EXPECT_EQ("3", section.FindS("Version"));
+  ASSERT_TRUE(tfile.Jump(section, offsets[0]));
+  EXPECT_EQ("pkgA", section.FindS("Package"));
+  EXPECT_EQ("1", section.FindS("Version"));
+  EXPECT_FALSE(tfile.Jump(section, offsets[3] + 10));
+}
+
+TEST(TagFileTest, ForEachSection)
+{
+  // enough sections for a few chunks, the last one without its newlines
+  std::string content;
+  for (size_t i = 0; i < 5000; ++i)
+  {
+    content.append("Package: pkg").append(std::to_string(i)).append("\n");
+    content.append("Description: ").append(i % 100, 'x').append("\n");
+    if (i % 13 == 0)
+      content.append(" more\n\n");
+    content.append(i % 17 == 0 ? "\n\n" : "\n");
+  }
+  content.append("Package: last\nVersion: 1");
+  FileFd fd;
+  openTemporaryFile("foreachsection", fd, content.c_str());
+
+  std::vector<std::pair<unsigned long long, std::string>> expected;
+  {
+    pkgTagFile tfile(&fd);
+    pkgTagSection section;
+    unsigned long long offset = tfile.Offset();
+    while (tfile.Step(section))
+    {
+      expected.emplace_back(offset, section.FindS("Package") + "|" + section.FindS("Description") + "|" + std::to_string(section.size()));
+      offset = tfile.Offset();
+    }
+  }
+  ASSERT_EQ(5001u, expected.size());
+
+  for (auto const flags : {pkgTagFile::STRICT, pkgTagFile::MMAP})
+  {
+    for (bool const ordered : {true, false})
+    {
+      ASSERT_TRUE(fd.Seek(0));
+      pkgTagFile tfile(&fd, flags);
+      std::vector<std::pair<unsigned long long, std::string>> found;
+      auto const collect = [&](pkgTagSection &section, unsigned long long const offset)
+      {
+        found.emplace_back(offset, section.FindS("Package") + "|" + section.FindS("Description") + "|" + std::to_string(section.size()));
+        return true;
+      };
+      std::mutex lock;
+      auto const collectLocked = [&](pkgTagSection &section, unsigned long long const offset)
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        return collect(section, offset);
+      };
+      if (ordered)
+        EXPECT_TRUE(tfile.ForEachSection(collect, true, 4));
+      else
+      {
+        EXPECT_TRUE(tfile.ForEachSection(collectLocked, false, 4));
+        std::sort(found.begin(), found.end());
+      }
+      EXPECT_EQ(expected, found) << "flags " << flags << " ordered " << ordered;
+      pkgTagSection section;
+      EXPECT_FALSE(tfile.Step(section));
+    }
+  }
+
+  // the iteration stops if the callback says so
+  ASSERT_TRUE(fd.Seek(0));
+  pkgTagFile tfile(&fd);
+  size_t count = 0;
+  EXPECT_FALSE(tfile.ForEachSection([&](pkgTagSection &, unsigned long long) noexcept
+                                    { return ++count != 1000; },
+                                    true, 4));
+  EXPECT_EQ(1000u, count);
+
+  // messages of the helper threads are passed on with their type
+  ASSERT_TRUE(fd.Seek(0));
+  pkgTagFile noticefile(&fd);
+  EXPECT_TRUE(_error->empty(GlobalError::DEBUG));
+  EXPECT_TRUE(noticefile.ForEachSection([&](pkgTagSection &section, unsigned long long)
+                                        {
+                                          _error->Notice("%s", section.FindS("Package").c_str());
+                                          return true;
+                                        },
+                                        false, 4));
+  EXPECT_TRUE(_error->empty(GlobalError::WARNING));
+  size_t notices = 0;
+  std::string text;
+  GlobalError::MsgType type;
+  while (_error->PopMessage(text, type))
+  {
+    EXPECT_EQ(GlobalError::NOTICE, type) << text;
+    ++notices;
+  }
+  EXPECT_EQ(expected.size(), notices);
+}
+
 TEST(TagFileTest, Comments)
 {
   FileFd fd;
@@ -233,3 +233,42 @@ TEST(TagSectionTest, WriteOrderRewrite)
   EXPECT_EQ(1, section.FindI("Override-Backup"));
   EXPECT_EQ(4u, section.Count());
 }
+TEST(TagSectionTest, WriteExactContent)
+{
+  FileFd fd;
+  openTemporaryFile("writesectionexact", fd);
+  std::string const content = "Package: aaaa\n"
+                              "section: misc\n"
+                              "Empty:\n"
+                              "Multi:\n"
+                              " line one\n"
+                              " line two\n"
+                              "Compact:bb\n"
+                              "Old: value\n"
+                              "Keep: 1\n"
+                              "\n";
+  pkgTagSection section;
+  ASSERT_TRUE(section.Scan(content.c_str(), content.length(), true));
+  std::vector<pkgTagSection::Tag> rewrite;
+  rewrite.push_back(pkgTagSection::Tag::Rename("Old", "New"));
+  rewrite.push_back(pkgTagSection::Tag::Rewrite("Keep", "2"));
+  rewrite.push_back(pkgTagSection::Tag::Rewrite("Added", "3"));
+  char const *const order[] = {"Package", "Section", "Missing", "Keep", NULL};
+  // the second write reuses what the first one set up
+  EXPECT_TRUE(section.Write(fd, order, rewrite));
+  EXPECT_TRUE(section.Write(fd, order, rewrite));
+  std::string const expected = "Package: aaaa\n"
+                               "Section: misc\n"
+                               "Keep: 2\n"
+                               "Empty:\n"
+                               "Multi:\n"
+                               " line one\n"
+                               " line two\n"
+                               "Compact: bb\n"
+                               "New: value\n"
+                               "Added: 3\n";
+  EXPECT_TRUE(fd.Seek(0));
+  std::string written(fd.Size(), '\0');
+  ASSERT_TRUE(fd.Read(&written[0], written.size()));
+  EXPECT_EQ(expected + expected, written);
+}